@@ -0,0 +1,71 @@
+/* Helpers shared by the on-disk caches: key hashing, cache file names and atomic file writes */
+#include "cache_file.h"
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <system_error>
+
+static const std::string cache_directory{ "cache" };
+
+// Feed size bytes at data into the 64-bit FNV-1a hash
+void fnv1a(uint64_t& hash, const void* data, const size_t size)
+{
+	const unsigned char* bytes{ static_cast<const unsigned char*>(data) };
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 0x100000001B3ull;
+	}
+}
+
+// Feed a string and its length into the hash, so the boundaries between strings count
+void fnv1a(uint64_t& hash, const char* string)
+{
+	const uint64_t length{ string ? std::strlen(string) : 0 };
+	fnv1a(hash, &length, sizeof(length));
+	fnv1a(hash, string, length);
+}
+
+// Path of the cache file named prefix for key, in the cache directory next to settings.ini
+std::string cache_filename(const char* prefix, const uint64_t key)
+{
+	std::ostringstream filename;
+	filename << cache_directory << "/" << prefix << "_" << std::hex << std::setw(16) << std::setfill('0') << key << ".bin";
+	return filename.str();
+}
+
+/* Create the cache directory and write filename with write. The file is written under a temporary name and renamed
+	when complete, so a partially written file is never loaded. Errors are reported as coming from caller. */
+void write_cache_file(const std::string& filename, const std::function<void(std::ostream&)>& write, const char* caller)
+{
+	std::error_code error;
+	std::filesystem::create_directories(cache_directory, error);
+	const std::string temp_filename{ filename + ".tmp" };
+	{
+		std::ofstream out(temp_filename, std::ios::binary | std::ios::trunc);
+		if (!out.is_open())
+		{
+			std::cerr << caller << " failed to open file " << temp_filename << "\n";
+			return;
+		}
+		write(out);
+		if (!out)
+		{
+			std::cerr << caller << " failed to write file " << temp_filename << "\n";
+			out.close();
+			std::filesystem::remove(temp_filename, error);
+			return;
+		}
+	}
+
+	std::filesystem::rename(temp_filename, filename, error);
+	if (error)
+	{
+		std::cerr << caller << " failed to rename " << temp_filename << " to " << filename << ": " << error.message() << "\n";
+		std::filesystem::remove(temp_filename, error);
+	}
+}
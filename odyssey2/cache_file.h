@@ -0,0 +1,23 @@
+/* Helpers shared by the on-disk caches: key hashing, cache file names and atomic file writes */
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string>
+
+// Start value of a 64-bit FNV-1a hash
+constexpr uint64_t fnv1a_offset_basis{ 0xCBF29CE484222325ull };
+
+// Feed size bytes at data into the 64-bit FNV-1a hash
+void fnv1a(uint64_t& hash, const void* data, const size_t size);
+
+// Feed a string and its length into the hash, so the boundaries between strings count
+void fnv1a(uint64_t& hash, const char* string);
+
+// Path of the cache file named prefix for key, in the cache directory next to settings.ini
+std::string cache_filename(const char* prefix, const uint64_t key);
+
+/* Create the cache directory and write filename with write. The file is written under a temporary name and renamed
+	when complete, so a partially written file is never loaded. Errors are reported as coming from caller. */
+void write_cache_file(const std::string& filename, const std::function<void(std::ostream&)>& write, const char* caller);
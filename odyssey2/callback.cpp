@@ -10,11 +10,14 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
 	if (key == GLFW_KEY_ESCAPE)
 		glfwSetWindowShouldClose(window, GLFW_TRUE);
 
-	Camera& camera = *static_cast<Camera*>(glfwGetWindowUserPointer(window));
+	// Camera is not set while the world is loading
+	Camera* camera = static_cast<Camera*>(glfwGetWindowUserPointer(window));
+	if (!camera)
+		return;
 	// Update key state for movement handling if key is bound
-	auto search = camera.key_state.find(key);
-	if (search != camera.key_state.end())
-		camera.key_state[key] = action;
+	auto search = camera->key_state.find(key);
+	if (search != camera->key_state.end())
+		camera->key_state[key] = action;
 }
 
 // Handle mouse movement
@@ -29,18 +32,21 @@ void cursor_pos_callback(GLFWwindow* window, double xpos, double ypos)
 	mouse_last_x = xpos;
 	mouse_last_y = ypos;
 
-	Camera& camera = *static_cast<Camera*>(glfwGetWindowUserPointer(window));
-	camera.process_mouse_movement(x_offset, y_offset);
+	Camera* camera = static_cast<Camera*>(glfwGetWindowUserPointer(window));
+	if (camera)
+		camera->process_mouse_movement(x_offset, y_offset);
 }
 
 // Handle window resize by updating the projection matrix and viewport size
 void fb_size_callback(GLFWwindow* window, int width, int height)
 {
-	Camera& camera = *static_cast<Camera*>(glfwGetWindowUserPointer(window));
-	camera.aspect_ratio = static_cast<float>(width) / height;
-	// Skybox clips if aspect ratio is too wide for chosen vp_near
-	camera.projection = glm::perspective(glm::radians(camera.cam_fov), static_cast<float>(width) / height, camera.vp_near, camera.vp_far);
 	glViewport(0, 0, width, height);
+	Camera* camera = static_cast<Camera*>(glfwGetWindowUserPointer(window));
+	if (!camera)
+		return;
+	camera->aspect_ratio = static_cast<float>(width) / height;
+	// Skybox clips if aspect ratio is too wide for chosen vp_near
+	camera->projection = glm::perspective(glm::radians(camera->cam_fov), static_cast<float>(width) / height, camera->vp_near, camera->vp_far);
 }
 
 // Display an error code and description on GLFW error
@@ -18,7 +18,7 @@ glm::mat4 Camera::get_view_matrix() const
 }
 
 // Process input received from keyboard-like input system
-void Camera::process_keyboard(const std::vector<GLfloat>& terrain, const float world_xz_scale, const double delta_time)
+void Camera::process_keyboard(const Heightfield& terrain, const double delta_time)
 {
 	float velocity = movement_speed * static_cast<float>(delta_time);
 	if (flying)
@@ -74,7 +74,7 @@ void Camera::process_keyboard(const std::vector<GLfloat>& terrain, const float w
 			position -= glm::normalize(glm::vec3(0.0f, up.y, 0.0f)) * velocity;
 	}
 	else
-		set_pos(terrain, world_xz_scale);
+		set_pos(terrain);
 }
 
 // Process input received from a mouse input system. Expects the offset value in both the x and y direction.
@@ -93,15 +93,11 @@ void Camera::process_mouse_movement(const float x_offset, const float y_offset)
 	update_camera_vectors();
 }
 
-// Interpolate height over the vertex at position (x, z)
-// Interpolations is done over a single triangle, but should probably
-// be done over several to smooth transitions between triangles
-void Camera::set_pos(const std::vector<GLfloat>& vertex_array, const float world_xz_scale)
+// Place the camera on the terrain surface at position (x, z), on the same triangle as the rendered mesh
+void Camera::set_pos(const Heightfield& terrain)
 {
-	// #vertices in 1 dimension (world_size)
-	unsigned int num_vert_1D = static_cast<unsigned int>(sqrt(vertex_array.size() / 3));
-	// Keep player in bounds, padding ensures arrays stay in bound during interpolation
-	const float world_limit = world_xz_scale * (num_vert_1D - 1);
+	// Keep player in bounds
+	const float world_limit = terrain.xz_scale() * (terrain.width() - 1);
 	if (position.x < 0.0f)
 		position.x = 0.0f;
 	else if (position.x > world_limit)
@@ -111,19 +107,7 @@ void Camera::set_pos(const std::vector<GLfloat>& vertex_array, const float world
 	else if (position.z > world_limit)
 		position.z = world_limit;
 
-	const float x{ position.x / world_xz_scale };
-	const float z{ position.z / world_xz_scale };
-	const size_t x_tile{ static_cast<size_t>(x) };
-	const size_t z_tile{ static_cast<size_t>(z) };
-	const float x_pos{ x - x_tile };
-	const float z_pos{ z - z_tile };
-
-	// Interpolate over the triangle at the current player position
-	// Interpolation is done into higher x and z
-	const float y1 = vertex_array[(x_tile + z_tile * num_vert_1D) * 3 + 1];
-	const float y2 = vertex_array[(((x_tile + 1) % num_vert_1D) + z_tile * num_vert_1D) * 3 + 1];
-	const float y3 = vertex_array[(x_tile + ((z_tile + 1) % num_vert_1D) * num_vert_1D) * 3 + 1];
-	const float y_pos = y1 + x_pos * (y2 - y1) + z_pos * (y3 - y1) + height;
+	const float y_pos = terrain.height(position.x, position.z) + height;
 
 	// Make sure player does not drown
 	if (y_pos > swim_height)
@@ -1,4 +1,5 @@
 #pragma once
+#include "heightfield.h"
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include <glm/mat4x4.hpp>
@@ -54,7 +55,8 @@ public:
 		{ GLFW_KEY_LEFT_CONTROL, GLFW_RELEASE },
 		{ GLFW_KEY_F1, GLFW_RELEASE },
 		{ GLFW_KEY_F2, GLFW_RELEASE },
-		{ GLFW_KEY_F3, GLFW_RELEASE }
+		{ GLFW_KEY_F3, GLFW_RELEASE },
+		{ GLFW_KEY_F4, GLFW_RELEASE }
 	};
 
 	Camera(const float sea_height);
@@ -63,14 +65,14 @@ public:
 	glm::mat4 get_view_matrix() const;
 
 	// Processes input received from any keyboard-like input system. Accepts input parameter in the form of camera defined ENUM (to abstract it from windowing systems)
-	void process_keyboard(const std::vector<GLfloat>& terrain, const float world_xz_scale, const double delta_time);
+	void process_keyboard(const Heightfield& terrain, const double delta_time);
 
 	// Processes input received from a mouse input system. Expects the offset value in both the x and y direction.
 	void process_mouse_movement(const float x_offset, const float y_offset);
 
 private:
-	// Interpolate height over the vertex at position (x, z)
-	void set_pos(const std::vector<GLfloat>& vertex_array, const float world_xz_scale);
+	// Place the camera on the terrain surface at position (x, z)
+	void set_pos(const Heightfield& terrain);
 
 	// Calculates the front vector from the Camera's (updated) Euler Angles
 	void update_camera_vectors();
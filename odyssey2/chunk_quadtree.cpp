@@ -0,0 +1,170 @@
+/* Quadtree of terrain chunk bounding boxes for frustum culling */
+#include "chunk_quadtree.h"
+#include "heightfield.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <vector>
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define CHUNK_QUADTREE_SSE
+#endif
+
+// Build the tree over chunks, which must be in the row-major order of terrain_chunk_layout or terrain_patch_layout
+Chunk_quadtree::Chunk_quadtree(const std::vector<Terrain_chunk>& chunks, const Heightfield& heightfield)
+{
+	if (chunks.empty())
+		return;
+	while (static_cast<size_t>(chunks_per_side) * chunks_per_side < chunks.size())
+		chunks_per_side++;
+
+	// World space bounds of every chunk, the heights are scanned row by row
+	const float scale{ heightfield.xz_scale() };
+	chunk_bounds.resize(chunks.size());
+	parallel_for(0, chunks.size(), [&](const size_t first, const size_t last)
+		{
+			std::vector<float> heights(terrain_chunk_cells + 1);
+			for (size_t c = first; c < last; c++)
+			{
+				const Terrain_chunk& chunk{ chunks[c] };
+				float min_height{ FLT_MAX };
+				float max_height{ -FLT_MAX };
+				for (unsigned int z = chunk.z; z <= chunk.z + chunk.cells_z; z++)
+				{
+					heightfield.decode(static_cast<size_t>(z) * heightfield.width() + chunk.x, chunk.cells_x + 1, heights.data());
+					const auto [min_it, max_it] = std::minmax_element(heights.begin(), heights.begin() + chunk.cells_x + 1);
+					min_height = std::min(min_height, *min_it);
+					max_height = std::max(max_height, *max_it);
+				}
+				chunk_bounds[c] = Bounds{ { chunk.x * scale, min_height, chunk.z * scale },
+					{ (chunk.x + chunk.cells_x) * scale, max_height, (chunk.z + chunk.cells_z) * scale } };
+			}
+		}, 16);
+
+	// The root is always a node, even for a single chunk
+	uint32_t size{ 2 };
+	while (size < chunks_per_side)
+		size *= 2;
+	Bounds bounds{};
+	uint32_t first_leaf{};
+	uint32_t leaf_count{};
+	build(chunk_bounds, 0, 0, size, bounds, first_leaf, leaf_count);
+}
+
+/* Build the subtree over the size*size chunks starting at chunk (x, z) and return its reference,
+	bounds and range in leaf_chunks */
+uint32_t Chunk_quadtree::build(const std::vector<Bounds>& chunk_bounds, const uint32_t x, const uint32_t z, const uint32_t size,
+	Bounds& bounds, uint32_t& first_leaf, uint32_t& leaf_count)
+{
+	bounds = Bounds{ { FLT_MAX, FLT_MAX, FLT_MAX }, { -FLT_MAX, -FLT_MAX, -FLT_MAX } };
+	first_leaf = static_cast<uint32_t>(leaf_chunks.size());
+	leaf_count = 0;
+	if (x >= chunks_per_side || z >= chunks_per_side)
+		return empty_child;
+	if (size == 1)
+	{
+		const uint32_t chunk{ x + z * chunks_per_side };
+		leaf_chunks.push_back(chunk);
+		bounds = chunk_bounds[chunk];
+		leaf_count = 1;
+		return chunk | leaf_flag;
+	}
+
+	const uint32_t node{ static_cast<uint32_t>(nodes.size()) };
+	nodes.emplace_back();
+	const uint32_t half{ size / 2 };
+	for (uint32_t q = 0; q < 4; q++)
+	{
+		Bounds child_bounds{};
+		uint32_t child_first{};
+		uint32_t child_count{};
+		const uint32_t child{ build(chunk_bounds, x + (q & 1) * half, z + (q >> 1) * half, half, child_bounds, child_first, child_count) };
+		Node& n{ nodes[node] }; // Not kept across build, which may grow nodes
+		n.child[q] = child;
+		n.first_leaf[q] = child_first;
+		n.leaf_count[q] = child_count;
+		n.min_x[q] = child_bounds.min[0];
+		n.min_y[q] = child_bounds.min[1];
+		n.min_z[q] = child_bounds.min[2];
+		n.max_x[q] = child_bounds.max[0];
+		n.max_y[q] = child_bounds.max[1];
+		n.max_z[q] = child_bounds.max[2];
+		for (int axis = 0; axis < 3; axis++)
+		{
+			bounds.min[axis] = std::min(bounds.min[axis], child_bounds.min[axis]);
+			bounds.max[axis] = std::max(bounds.max[axis], child_bounds.max[axis]);
+		}
+	}
+	leaf_count = static_cast<uint32_t>(leaf_chunks.size()) - first_leaf;
+	return node;
+}
+
+// Replace the contents of visible with the indices of the chunks that intersect frustum
+void Chunk_quadtree::cull(const Frustum& frustum, std::vector<uint32_t>& visible) const
+{
+	visible.clear();
+	if (!nodes.empty())
+		cull_node(frustum, 0, visible);
+}
+
+/* Cull the children of node and append visible chunks. For every plane only the box corner furthest along
+	the plane normal (p) and the one furthest against it (n) matter: a box is outside if p is behind
+	any plane and completely inside if n is in front of all of them. */
+void Chunk_quadtree::cull_node(const Frustum& frustum, const uint32_t node, std::vector<uint32_t>& visible) const
+{
+	const Node& n{ nodes[node] };
+	int outside_mask{ 0 };
+	int inside_mask{ 0xF };
+#ifdef CHUNK_QUADTREE_SSE
+	__m128 outside{ _mm_setzero_ps() };
+	__m128 inside{ _mm_cmpeq_ps(outside, outside) };
+	for (const glm::vec4& plane : frustum.planes)
+	{
+		const __m128 px{ _mm_loadu_ps(plane.x >= 0.0f ? n.max_x : n.min_x) };
+		const __m128 py{ _mm_loadu_ps(plane.y >= 0.0f ? n.max_y : n.min_y) };
+		const __m128 pz{ _mm_loadu_ps(plane.z >= 0.0f ? n.max_z : n.min_z) };
+		const __m128 nx{ _mm_loadu_ps(plane.x >= 0.0f ? n.min_x : n.max_x) };
+		const __m128 ny{ _mm_loadu_ps(plane.y >= 0.0f ? n.min_y : n.max_y) };
+		const __m128 nz{ _mm_loadu_ps(plane.z >= 0.0f ? n.min_z : n.max_z) };
+		const __m128 a{ _mm_set1_ps(plane.x) };
+		const __m128 b{ _mm_set1_ps(plane.y) };
+		const __m128 c{ _mm_set1_ps(plane.z) };
+		const __m128 d{ _mm_set1_ps(plane.w) };
+		const __m128 p_distance{ _mm_add_ps(_mm_add_ps(_mm_mul_ps(a, px), _mm_mul_ps(b, py)), _mm_add_ps(_mm_mul_ps(c, pz), d)) };
+		const __m128 n_distance{ _mm_add_ps(_mm_add_ps(_mm_mul_ps(a, nx), _mm_mul_ps(b, ny)), _mm_add_ps(_mm_mul_ps(c, nz), d)) };
+		outside = _mm_or_ps(outside, _mm_cmplt_ps(p_distance, _mm_setzero_ps()));
+		inside = _mm_and_ps(inside, _mm_cmpge_ps(n_distance, _mm_setzero_ps()));
+	}
+	outside_mask = _mm_movemask_ps(outside);
+	inside_mask = _mm_movemask_ps(inside);
+#else
+	for (const glm::vec4& plane : frustum.planes)
+	{
+		for (int q = 0; q < 4; q++)
+		{
+			const float p_distance{ plane.x * (plane.x >= 0.0f ? n.max_x[q] : n.min_x[q]) + plane.y * (plane.y >= 0.0f ? n.max_y[q] : n.min_y[q]) +
+				plane.z * (plane.z >= 0.0f ? n.max_z[q] : n.min_z[q]) + plane.w };
+			const float n_distance{ plane.x * (plane.x >= 0.0f ? n.min_x[q] : n.max_x[q]) + plane.y * (plane.y >= 0.0f ? n.min_y[q] : n.max_y[q]) +
+				plane.z * (plane.z >= 0.0f ? n.min_z[q] : n.max_z[q]) + plane.w };
+			if (p_distance < 0.0f)
+				outside_mask |= 1 << q;
+			if (!(n_distance >= 0.0f))
+				inside_mask &= ~(1 << q);
+		}
+	}
+#endif
+
+	for (int q = 0; q < 4; q++)
+	{
+		const uint32_t child{ n.child[q] };
+		if (child == empty_child || (outside_mask & (1 << q)))
+			continue;
+		if (inside_mask & (1 << q))
+			visible.insert(visible.end(), leaf_chunks.begin() + n.first_leaf[q], leaf_chunks.begin() + n.first_leaf[q] + n.leaf_count[q]);
+		else if (child & leaf_flag)
+			visible.push_back(child & ~leaf_flag);
+		else
+			cull_node(frustum, child, visible);
+	}
+}
@@ -0,0 +1,72 @@
+/* Quadtree of terrain chunk bounding boxes for frustum culling */
+#pragma once
+#include "frustum.h"
+#include "heightfield.h"
+#include "terrain_mesh.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/* Quadtree over the chunks of a Terrain_chunk_layout or the patches of terrain_patch_layout. Every node holds
+	the bounding boxes of its four children side by side, so a plane is tested against all four with one set of SIMD operations.
+	Subtrees completely inside the frustum are accepted without testing their children. */
+class Chunk_quadtree
+{
+public:
+	Chunk_quadtree() = default;
+
+	// Build the tree over chunks, which must be in the row-major order of terrain_chunk_layout or terrain_patch_layout
+	Chunk_quadtree(const std::vector<Terrain_chunk>& chunks, const Heightfield& heightfield);
+
+	// Replace the contents of visible with the indices of the chunks that intersect frustum
+	void cull(const Frustum& frustum, std::vector<uint32_t>& visible) const;
+
+	// Number of chunks in the tree
+	size_t chunk_count() const { return leaf_chunks.size(); }
+
+	// Lowest and highest height of chunk
+	void height_range(const uint32_t chunk, float& min, float& max) const
+	{
+		min = chunk_bounds[chunk].min[1];
+		max = chunk_bounds[chunk].max[1];
+	}
+
+private:
+	// Reference to a child: a node index, a chunk (leaf_flag set) or nothing
+	static constexpr uint32_t leaf_flag{ 0x80000000u };
+	static constexpr uint32_t empty_child{ 0xFFFFFFFFu };
+
+	// Bounds of the four children of a node as structure of arrays
+	struct Node
+	{
+		float min_x[4];
+		float min_y[4];
+		float min_z[4];
+		float max_x[4];
+		float max_y[4];
+		float max_z[4];
+		uint32_t child[4];
+		uint32_t first_leaf[4]; // Range of the child's chunks in leaf_chunks
+		uint32_t leaf_count[4];
+	};
+
+	// Bounding box of one chunk or subtree
+	struct Bounds
+	{
+		float min[3];
+		float max[3];
+	};
+
+	/* Build the subtree over the size*size chunks starting at chunk (x, z) and return its reference,
+		bounds and range in leaf_chunks */
+	uint32_t build(const std::vector<Bounds>& chunk_bounds, const uint32_t x, const uint32_t z, const uint32_t size,
+		Bounds& bounds, uint32_t& first_leaf, uint32_t& leaf_count);
+
+	// Cull the children of node and append visible chunks
+	void cull_node(const Frustum& frustum, const uint32_t node, std::vector<uint32_t>& visible) const;
+
+	std::vector<Node> nodes{}; // nodes[0] is the root
+	std::vector<uint32_t> leaf_chunks{}; // Chunk indices in depth-first order, so every subtree is one range
+	std::vector<Bounds> chunk_bounds{}; // Bounds of every chunk by chunk index
+	uint32_t chunks_per_side{ 0 };
+};
@@ -0,0 +1,21 @@
+/* Per-frame uniforms shared by all shaders through one uniform buffer */
+#include "frame_uniforms.h"
+#include <glad/glad.h>
+
+// Create the uniform buffer for Frame_uniforms and bind it to frame_uniforms_binding, requires a current OpenGL context
+GLuint create_frame_uniform_buffer()
+{
+	GLuint buffer{};
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(Frame_uniforms), nullptr, GL_DYNAMIC_DRAW);
+	glBindBufferBase(GL_UNIFORM_BUFFER, frame_uniforms_binding, buffer);
+	return buffer;
+}
+
+// Replace the contents of buffer with frame, called once per frame before drawing
+void update_frame_uniform_buffer(const GLuint buffer, const Frame_uniforms& frame)
+{
+	glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(Frame_uniforms), &frame);
+}
@@ -0,0 +1,32 @@
+/* Per-frame uniforms shared by all shaders through one uniform buffer */
+#pragma once
+#include <glad/glad.h>
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include <cstddef>
+
+// Uniform buffer binding point of the Frame block, programs using the block are bound to it by Shader
+constexpr GLuint frame_uniforms_binding{ 0 };
+
+/* CPU copy of the Frame uniform block in shader/frame.glsl. With std140 rules every vec3 starts a new
+	16-byte slot and the following scalar fills its last four bytes. The block's size is rounded up to 16 bytes. */
+struct Frame_uniforms
+{
+	glm::mat4 world_to_view{ 1.0f };
+	glm::mat4 projection{ 1.0f };
+	glm::mat4 sky_world_to_view{ 1.0f }; // world_to_view without the translation
+	glm::mat4 normal_matrix{ 1.0f }; // Inverse transpose of the rotation of world_to_view, in the upper 3x3
+	glm::vec3 camera_position{ 0.0f };
+	GLfloat time{ 0.0f }; // Seconds since start
+	glm::vec3 fog_color{ 0.0f };
+	GLfloat padding{ 0.0f }; // Rest of the last slot, not in the block
+};
+static_assert(offsetof(Frame_uniforms, camera_position) == 256 && offsetof(Frame_uniforms, time) == 268 &&
+	offsetof(Frame_uniforms, fog_color) == 272 && sizeof(Frame_uniforms) == 288,
+	"Frame_uniforms must match the std140 layout of the Frame block");
+
+// Create the uniform buffer for Frame_uniforms and bind it to frame_uniforms_binding, requires a current OpenGL context
+GLuint create_frame_uniform_buffer();
+
+// Replace the contents of buffer with frame, called once per frame before drawing
+void update_frame_uniform_buffer(const GLuint buffer, const Frame_uniforms& frame);
@@ -0,0 +1,34 @@
+/* View frustum planes for culling */
+#include "frustum.h"
+#include <glm/geometric.hpp>
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+// Extract the frustum planes from an OpenGL projection * view matrix (Gribb-Hartmann), in world coordinates
+Frustum extract_frustum(const glm::mat4& view_projection)
+{
+	// A point is inside if -w <= x, y, z <= w in clip space, each inequality is one row combination
+	const glm::mat4& m{ view_projection };
+	const glm::vec4 row0{ m[0][0], m[1][0], m[2][0], m[3][0] };
+	const glm::vec4 row1{ m[0][1], m[1][1], m[2][1], m[3][1] };
+	const glm::vec4 row2{ m[0][2], m[1][2], m[2][2], m[3][2] };
+	const glm::vec4 row3{ m[0][3], m[1][3], m[2][3], m[3][3] };
+	Frustum frustum{ { row3 + row0, row3 - row0, row3 + row1, row3 - row1, row3 + row2, row3 - row2 } };
+	for (glm::vec4& plane : frustum.planes)
+		plane /= glm::length(glm::vec3(plane));
+	return frustum;
+}
+
+// True if the axis-aligned box from min to max is at least partly inside frustum, may be true for some boxes just outside a corner
+bool intersects(const Frustum& frustum, const glm::vec3& min, const glm::vec3& max)
+{
+	// The box is outside if its corner furthest along the normal of any plane is behind it
+	for (const glm::vec4& plane : frustum.planes)
+	{
+		const glm::vec3 corner{ plane.x >= 0.0f ? max.x : min.x, plane.y >= 0.0f ? max.y : min.y, plane.z >= 0.0f ? max.z : min.z };
+		if (glm::dot(glm::vec3(plane), corner) + plane.w < 0.0f)
+			return false;
+	}
+	return true;
+}
@@ -0,0 +1,18 @@
+/* View frustum planes for culling */
+#pragma once
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+/* Six planes (left, right, bottom, top, near, far) of a view frustum. Each plane is (normal, w) with the
+	normal pointing into the frustum and normalized, so dot(normal, p) + w is the distance of point p inside the plane. */
+struct Frustum
+{
+	glm::vec4 planes[6];
+};
+
+// Extract the frustum planes from an OpenGL projection * view matrix (Gribb-Hartmann), in world coordinates
+Frustum extract_frustum(const glm::mat4& view_projection);
+
+// True if the axis-aligned box from min to max is at least partly inside frustum, may be true for some boxes just outside a corner
+bool intersects(const Frustum& frustum, const glm::vec3& min, const glm::vec3& max);
@@ -0,0 +1,300 @@
+/* Min/max height pyramid over a Heightfield for hierarchical raycasting */
+#include "height_pyramid.h"
+#include "heightfield.h"
+#include "parallel.h"
+#include <glm/geometric.hpp>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <vector>
+
+// Build the pyramid for heightfield
+Height_pyramid::Height_pyramid(const Heightfield& heightfield)
+{
+	const size_t width{ heightfield.width() };
+	const size_t cells{ width - 1 };
+	dimension = 1;
+	while (dimension < cells)
+		dimension *= 2;
+	while ((dimension >> top_level) > 1)
+		top_level++;
+	levels.resize(static_cast<size_t>(top_level) + 1);
+	if (top_level == 0)
+		return;
+
+	// Level 1 nodes cover 2x2 cells, which is 3x3 grid points read from three decoded rows
+	const size_t dim1{ dimension / 2 };
+	levels[1].assign(dim1 * dim1, Node{ FLT_MAX, -FLT_MAX });
+	parallel_for(0, dim1, [&](const size_t first_row, const size_t last_row)
+		{
+			std::vector<float> rows(3 * width);
+			for (size_t z = first_row; z < last_row && z * 2 < cells; z++)
+			{
+				const size_t z_last{ std::min(z * 2 + 2, cells) };
+				for (size_t row = z * 2; row <= z_last; row++)
+					heightfield.decode(row * width, width, rows.data() + (row - z * 2) * width);
+				for (size_t x = 0; x * 2 < cells; x++)
+				{
+					const size_t x_last{ std::min(x * 2 + 2, cells) };
+					Node& node{ levels[1][z * dim1 + x] };
+					for (size_t row = 0; row <= z_last - z * 2; row++)
+					{
+						for (size_t col = x * 2; col <= x_last; col++)
+						{
+							node.min = std::min(node.min, rows[row * width + col]);
+							node.max = std::max(node.max, rows[row * width + col]);
+						}
+					}
+				}
+			}
+		}, 16);
+
+	// Every higher node covers 2x2 nodes of the level below
+	for (int level = 2; level <= top_level; level++)
+	{
+		const size_t dim{ dimension >> level };
+		const std::vector<Node>& below{ levels[level - 1] };
+		std::vector<Node>& nodes{ levels[level] };
+		nodes.resize(dim * dim);
+		parallel_for(0, dim, [&](const size_t first_row, const size_t last_row)
+			{
+				for (size_t z = first_row; z < last_row; z++)
+				{
+					for (size_t x = 0; x < dim; x++)
+					{
+						const Node& n00{ below[(z * 2) * dim * 2 + x * 2] };
+						const Node& n10{ below[(z * 2) * dim * 2 + x * 2 + 1] };
+						const Node& n01{ below[(z * 2 + 1) * dim * 2 + x * 2] };
+						const Node& n11{ below[(z * 2 + 1) * dim * 2 + x * 2 + 1] };
+						nodes[z * dim + x] = Node{ std::min({ n00.min, n10.min, n01.min, n11.min }),
+							std::max({ n00.max, n10.max, n01.max, n11.max }) };
+					}
+				}
+			}, 64);
+	}
+}
+
+// Height range of node (x, z) at level, cells are read from the heightfield
+Height_pyramid::Node Height_pyramid::node(const Heightfield& heightfield, const int level, const size_t x, const size_t z) const
+{
+	if (level > 0)
+		return levels[level][z * (dimension >> level) + x];
+	const size_t cells{ heightfield.width() - 1u };
+	if (x >= cells || z >= cells)
+		return Node{ FLT_MAX, -FLT_MAX };
+	const float h00{ heightfield.at(x, z) };
+	const float h10{ heightfield.at(x + 1, z) };
+	const float h01{ heightfield.at(x, z + 1) };
+	const float h11{ heightfield.at(x + 1, z + 1) };
+	return Node{ std::min({ h00, h10, h01, h11 }), std::max({ h00, h10, h01, h11 }) };
+}
+
+/* Lowest and highest height of node (x, z) at level, which covers the 2^level * 2^level grid cells
+	starting at cell (x * 2^level, z * 2^level). min > max for nodes outside the grid. */
+void Height_pyramid::height_range(const Heightfield& heightfield, const int level, const size_t x, const size_t z,
+	float& min, float& max) const
+{
+	const size_t dim{ dimension >> level };
+	const Node range{ x < dim && z < dim ? node(heightfield, level, x, z) : Node{ FLT_MAX, -FLT_MAX } };
+	min = range.min;
+	max = range.max;
+}
+
+// Distance along direction from origin to triangle (a, b, c) (Moller-Trumbore), negative on a miss
+static float intersect_triangle(const glm::vec3& origin, const glm::vec3& direction,
+	const glm::vec3& a, const glm::vec3& b, const glm::vec3& c)
+{
+	const glm::vec3 edge1{ b - a };
+	const glm::vec3 edge2{ c - a };
+	const glm::vec3 p{ glm::cross(direction, edge2) };
+	const float det{ glm::dot(edge1, p) };
+	if (det == 0.0f)
+		return -1.0f; // Ray parallel to triangle
+	const float inv_det{ 1.0f / det };
+	const glm::vec3 s{ origin - a };
+	const float u{ glm::dot(s, p) * inv_det };
+	if (u < 0.0f || u > 1.0f)
+		return -1.0f;
+	const glm::vec3 q{ glm::cross(s, edge1) };
+	const float v{ glm::dot(direction, q) * inv_det };
+	if (v < 0.0f || u + v > 1.0f)
+		return -1.0f;
+	return glm::dot(edge2, q) * inv_det;
+}
+
+/* Walk the quadtree along the ray and store the first hit in hit. Nodes the ray passes above are skipped
+	whole, otherwise the walk descends into the child the ray is in. After stepping to a neighbour the walk
+	climbs back up as long as the neighbour lies in another parent, so large empty areas are skipped again. */
+bool Height_pyramid::trace(const Heightfield& heightfield, const glm::vec3& origin, const glm::vec3& direction,
+	const float max_distance, const bool any_hit, Ray_hit& hit) const
+{
+	const float length{ glm::length(direction) };
+	if (!(length > 0.0f) || levels.empty())
+		return false;
+	const glm::vec3 dir{ direction / length };
+
+	// x and z are walked in grid units, y stays in world units, t is the world distance along dir
+	const float scale{ heightfield.xz_scale() };
+	const float ox{ origin.x / scale };
+	const float oz{ origin.z / scale };
+	const float dx{ dir.x / scale };
+	const float dz{ dir.z / scale };
+	const float inv_dx{ 1.0f / dx };
+	const float inv_dz{ 1.0f / dz };
+
+	// Clip the ray to the bounding box of the terrain
+	float t_begin{ 0.0f };
+	float t_end{ max_distance };
+	const auto clip = [&](const float o, const float d, const float low, const float high)
+	{
+		if (d == 0.0f)
+		{
+			if (o < low || o > high)
+				t_end = -1.0f;
+			return;
+		}
+		const float t0{ (low - o) / d };
+		const float t1{ (high - o) / d };
+		t_begin = std::max(t_begin, std::min(t0, t1));
+		t_end = std::min(t_end, std::max(t0, t1));
+	};
+	const float extent{ static_cast<float>(heightfield.width() - 1) };
+	clip(ox, dx, 0.0f, extent);
+	clip(oz, dz, 0.0f, extent);
+	const Node root{ node(heightfield, top_level, 0, 0) };
+	if (any_hit && t_begin <= t_end && std::min(origin.y + dir.y * t_begin, origin.y + dir.y * t_end) < root.min)
+		return true; // Passes below the lowest point of the terrain
+	clip(origin.y, dir.y, root.min, root.max);
+	if (t_begin > t_end)
+		return false;
+
+	// Integer cell coordinates keep the conversions to float in the loop cheap
+	int level{ top_level };
+	int32_t cx{ 0 };
+	int32_t cz{ 0 };
+	float t{ t_begin };
+	while (true)
+	{
+		// Distance at which the ray leaves the node through its x and z faces
+		const float size{ static_cast<float>(1 << level) };
+		float tx{ FLT_MAX };
+		float tz{ FLT_MAX };
+		if (dx > 0.0f)
+			tx = ((cx + 1) * size - ox) * inv_dx;
+		else if (dx < 0.0f)
+			tx = (cx * size - ox) * inv_dx;
+		if (dz > 0.0f)
+			tz = ((cz + 1) * size - oz) * inv_dz;
+		else if (dz < 0.0f)
+			tz = (cz * size - oz) * inv_dz;
+		const float t_exit{ std::min({ tx, tz, t_end }) };
+
+		const float y_enter{ origin.y + dir.y * t };
+		const float y_exit{ origin.y + dir.y * t_exit };
+		const Node bounds{ node(heightfield, level, cx, cz) };
+		if (std::min(y_enter, y_exit) <= bounds.max)
+		{
+			if (any_hit && bounds.min <= bounds.max && std::max(y_enter, y_exit) < bounds.min)
+				return true; // Completely below the terrain in this node
+
+			if (level > 0)
+			{
+				// Descend into the child the ray is in at t
+				level--;
+				const float child_size{ size / 2 };
+				const float px{ ox + dx * t };
+				const float pz{ oz + dz * t };
+				cx = cx * 2 + (px >= (cx * 2 + 1) * child_size ? 1 : 0);
+				cz = cz * 2 + (pz >= (cz * 2 + 1) * child_size ? 1 : 0);
+				continue;
+			}
+
+			// Test the two mesh triangles of the cell, split like the rendered mesh
+			const glm::vec3 c00{ cx * scale, heightfield.at(cx, cz), cz * scale };
+			const glm::vec3 c10{ (cx + 1) * scale, heightfield.at(cx + 1, cz), cz * scale };
+			const glm::vec3 c01{ cx * scale, heightfield.at(cx, cz + 1), (cz + 1) * scale };
+			const glm::vec3 c11{ (cx + 1) * scale, heightfield.at(cx + 1, cz + 1), (cz + 1) * scale };
+			const float t1{ intersect_triangle(origin, dir, c00, c01, c10) };
+			const float t2{ intersect_triangle(origin, dir, c10, c01, c11) };
+			const bool hit1{ t1 >= 0.0f && t1 <= max_distance };
+			const bool hit2{ t2 >= 0.0f && t2 <= max_distance };
+			if (hit1 || hit2)
+			{
+				const bool first{ hit1 && (!hit2 || t1 <= t2) };
+				const float t_hit{ first ? t1 : t2 };
+				const glm::vec3 normal{ first ? glm::cross(c01 - c00, c10 - c00) : glm::cross(c01 - c10, c11 - c10) };
+				hit.hit = true;
+				hit.distance = t_hit;
+				hit.position = origin + dir * t_hit;
+				hit.normal = glm::normalize(normal.y < 0.0f ? -normal : normal);
+				return true;
+			}
+		}
+
+		if (t_exit >= t_end)
+			return false;
+		t = t_exit;
+
+		// Step to the neighbour through the face the ray leaves by
+		int32_t nx{ cx };
+		int32_t nz{ cz };
+		if (tx <= tz)
+			nx += dx > 0.0f ? 1 : -1;
+		else
+			nz += dz > 0.0f ? 1 : -1;
+		const int32_t level_dim{ static_cast<int32_t>(dimension >> level) };
+		if (nx < 0 || nz < 0 || nx >= level_dim || nz >= level_dim)
+			return false;
+
+		// Climb while the neighbour lies in another parent
+		while (level < top_level && ((nx >> 1) != (cx >> 1) || (nz >> 1) != (cz >> 1)))
+		{
+			level++;
+			nx >>= 1;
+			nz >>= 1;
+			cx >>= 1;
+			cz >>= 1;
+		}
+		cx = nx;
+		cz = nz;
+	}
+}
+
+// First hit of the ray from origin along direction within max_distance
+Ray_hit Height_pyramid::raycast(const Heightfield& heightfield, const glm::vec3& origin, const glm::vec3& direction,
+	const float max_distance) const
+{
+	Ray_hit hit{};
+	trace(heightfield, origin, direction, max_distance, false, hit);
+	return hit;
+}
+
+// Cast count rays in parallel
+void Height_pyramid::raycast(const Heightfield& heightfield, const glm::vec3* origins, const glm::vec3* directions, Ray_hit* hits,
+	const size_t count, const float max_distance) const
+{
+	parallel_for(0, count, [&](const size_t first, const size_t last)
+		{
+			for (size_t i = first; i < last; i++)
+				hits[i] = raycast(heightfield, origins[i], directions[i], max_distance);
+		}, 256);
+}
+
+// True if the segment between from and to does not pass through the terrain
+bool Height_pyramid::line_of_sight(const Heightfield& heightfield, const glm::vec3& from, const glm::vec3& to) const
+{
+	const glm::vec3 direction{ to - from };
+	Ray_hit hit{};
+	return !trace(heightfield, from, direction, glm::length(direction), true, hit);
+}
+
+// Check count segments in parallel
+void Height_pyramid::line_of_sight(const Heightfield& heightfield, const glm::vec3* from, const glm::vec3* to, unsigned char* visible,
+	const size_t count) const
+{
+	parallel_for(0, count, [&](const size_t first, const size_t last)
+		{
+			for (size_t i = first; i < last; i++)
+				visible[i] = line_of_sight(heightfield, from[i], to[i]) ? 1 : 0;
+		}, 256);
+}
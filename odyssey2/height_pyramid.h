@@ -0,0 +1,74 @@
+/* Min/max height pyramid over a Heightfield for hierarchical raycasting */
+#pragma once
+#include "heightfield.h"
+#include <glm/vec3.hpp>
+#include <cfloat>
+#include <cstddef>
+#include <vector>
+
+// Result of a ray cast against the terrain
+struct Ray_hit
+{
+	bool hit{ false };
+	float distance{ 0.0f }; // Distance from the ray origin, in world units
+	glm::vec3 position{ 0.0f };
+	glm::vec3 normal{ 0.0f }; // Unit normal of the hit mesh triangle, pointing up
+};
+
+/* Lowest and highest height of every node of a quadtree over the grid cells of a Heightfield.
+	Rays skip every node they pass above and only test the two mesh triangles of cells they come close to.
+	Level 0 (single cells) is read from the heightfield when needed, so the stored levels take about
+	two thirds of the memory of f32 heights. The heightfield is not referenced by the pyramid and must be
+	passed to each query, it has to be the one the pyramid was built from. */
+class Height_pyramid
+{
+public:
+	Height_pyramid() = default;
+
+	// Build the pyramid for heightfield
+	explicit Height_pyramid(const Heightfield& heightfield);
+
+	// First hit of the ray from origin along direction within max_distance, direction does not need to be normalized
+	Ray_hit raycast(const Heightfield& heightfield, const glm::vec3& origin, const glm::vec3& direction,
+		const float max_distance = FLT_MAX) const;
+
+	// Cast count rays in parallel
+	void raycast(const Heightfield& heightfield, const glm::vec3* origins, const glm::vec3* directions, Ray_hit* hits,
+		const size_t count, const float max_distance = FLT_MAX) const;
+
+	// True if the segment between from and to does not pass through the terrain
+	bool line_of_sight(const Heightfield& heightfield, const glm::vec3& from, const glm::vec3& to) const;
+
+	// Check count segments in parallel, visible[i] is set to 1 if the segment is unobstructed and 0 otherwise
+	void line_of_sight(const Heightfield& heightfield, const glm::vec3* from, const glm::vec3* to, unsigned char* visible,
+		const size_t count) const;
+
+	// Highest level, its single node covers the whole grid
+	int top() const { return top_level; }
+
+	/* Lowest and highest height of node (x, z) at level, which covers the 2^level * 2^level grid cells
+		starting at cell (x * 2^level, z * 2^level). min > max for nodes outside the grid. */
+	void height_range(const Heightfield& heightfield, const int level, const size_t x, const size_t z,
+		float& min, float& max) const;
+
+private:
+	// Height range of one quadtree node, empty nodes outside the grid have min > max
+	struct Node
+	{
+		float min;
+		float max;
+	};
+
+	// Height range of node (x, z) at level
+	Node node(const Heightfield& heightfield, const int level, const size_t x, const size_t z) const;
+
+	/* Walk the quadtree along the ray and store the first hit in hit. If any_hit is set the walk
+		stops at the first sign of an intersection, the hit is then only known to exist. */
+	bool trace(const Heightfield& heightfield, const glm::vec3& origin, const glm::vec3& direction,
+		const float max_distance, const bool any_hit, Ray_hit& hit) const;
+
+	// levels[l] holds (dimension >> l)^2 nodes covering 2^l*2^l cells each, levels[0] is not stored
+	std::vector<std::vector<Node>> levels{};
+	size_t dimension{ 0 }; // Number of cells along one side, padded to a power of two
+	int top_level{ 0 }; // Level with a single node covering the whole grid
+};
@@ -0,0 +1,97 @@
+/* Heightmap textures for drawing the terrain without vertex buffers */
+#include "height_texture.h"
+#include "heightfield.h"
+#include <glad/glad.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+/* Upload the heights of heightfield into a new texture, requires a current OpenGL context.
+	16-bit height formats are stored as R16 spread between min_height and max_height, f32 as R32F. */
+Height_texture upload_height_texture(const Heightfield& heightfield, const float min_height, const float max_height)
+{
+	const GLsizei width{ static_cast<GLsizei>(heightfield.width()) };
+	const Height_texture texture{ create_height_texture(GL_TEXTURE_2D, heightfield.format(), min_height, max_height, width, 1) };
+	update_height_texture(texture, heightfield, 0, 0, heightfield.width(), heightfield.width());
+	return texture;
+}
+
+/* Copy the width*depth grid points starting at (x, z) from heightfield into texture with a single sub-upload,
+	used after the heights in that rectangle were edited. Heights outside the range of the texture are clamped. */
+void update_height_texture(const Height_texture& texture, const Heightfield& heightfield,
+	const size_t x, const size_t z, const size_t width, const size_t depth)
+{
+	if (width == 0 || depth == 0)
+		return;
+
+	// Decode the rectangle row by row, quantizing it if the texture is R16
+	std::vector<float> heights(width * depth);
+	std::vector<uint16_t> quantized(texture.unorm16 ? width * depth : 0);
+	for (size_t row = 0; row < depth; row++)
+		heightfield.decode((z + row) * heightfield.width() + x, width, heights.data() + row * width);
+	if (texture.unorm16)
+		quantize_heights(texture, heights.data(), heights.size(), quantized.data());
+
+	const GLint unpack_alignment{ begin_height_upload() };
+	glBindTexture(GL_TEXTURE_2D, texture.id);
+	if (texture.unorm16)
+		glTexSubImage2D(GL_TEXTURE_2D, 0, static_cast<GLint>(x), static_cast<GLint>(z), static_cast<GLsizei>(width),
+			static_cast<GLsizei>(depth), GL_RED, GL_UNSIGNED_SHORT, quantized.data());
+	else
+		glTexSubImage2D(GL_TEXTURE_2D, 0, static_cast<GLint>(x), static_cast<GLint>(z), static_cast<GLsizei>(width),
+			static_cast<GLsizei>(depth), GL_RED, GL_FLOAT, heights.data());
+	end_height_upload(unpack_alignment);
+}
+
+/* Create a texture for heights of format, requires a current OpenGL context. target is GL_TEXTURE_2D or
+	GL_TEXTURE_2D_ARRAY with layers layers of width*width texels, the texture is left bound to target.
+	16-bit height formats are stored as R16 spread between min_height and max_height, f32 as R32F. */
+Height_texture create_height_texture(const GLenum target, const Height_format format, const float min_height,
+	const float max_height, const GLsizei width, const GLsizei layers)
+{
+	Height_texture texture{};
+	texture.unorm16 = format != Height_format::f32;
+	if (texture.unorm16)
+	{
+		texture.scale = max_height - min_height;
+		texture.offset = min_height;
+	}
+
+	const GLint internal_format{ texture.unorm16 ? GL_R16 : GL_R32F };
+	const GLenum type{ texture.unorm16 ? static_cast<GLenum>(GL_UNSIGNED_SHORT) : static_cast<GLenum>(GL_FLOAT) };
+	glGenTextures(1, &texture.id);
+	glBindTexture(target, texture.id);
+	// Heights are read with texelFetch, which wraps in the shader, so there is no filtering and no mipmaps
+	glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	if (target == GL_TEXTURE_2D_ARRAY)
+		glTexImage3D(target, 0, internal_format, width, width, layers, 0, GL_RED, type, nullptr);
+	else
+		glTexImage2D(target, 0, internal_format, width, width, 0, GL_RED, type, nullptr);
+	return texture;
+}
+
+// Set the unpack alignment for uploading rows of height texels, returns the previous alignment for end_height_upload
+GLint begin_height_upload()
+{
+	// Rows of 16-bit texels are not 4-byte aligned for odd widths
+	GLint unpack_alignment{};
+	glGetIntegerv(GL_UNPACK_ALIGNMENT, &unpack_alignment);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	return unpack_alignment;
+}
+
+// Restore the unpack alignment returned by begin_height_upload
+void end_height_upload(const GLint unpack_alignment)
+{
+	glPixelStorei(GL_UNPACK_ALIGNMENT, unpack_alignment);
+}
+
+// Quantize count heights to the R16 texels of a unorm16 texture, heights outside its range are clamped
+void quantize_heights(const Height_texture& texture, const float* heights, const size_t count, uint16_t* out)
+{
+	const float quantize_scale{ texture.scale > 0.0f ? 65535.0f / texture.scale : 0.0f };
+	for (size_t i = 0; i < count; i++)
+		out[i] = static_cast<uint16_t>(std::lround(std::clamp((heights[i] - texture.offset) * quantize_scale, 0.0f, 65535.0f)));
+}
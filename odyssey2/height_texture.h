@@ -0,0 +1,40 @@
+/* Heightmap textures for drawing the terrain without vertex buffers */
+#pragma once
+#include "heightfield.h"
+#include <glad/glad.h>
+#include <cstddef>
+#include <cstdint>
+
+/* Single channel texture holding the heights of a Heightfield, one texel per grid point.
+	The vertex shader reads heights with height = texel * scale + offset. */
+struct Height_texture
+{
+	GLuint id{ 0 };
+	bool unorm16{ false }; // R16 between the lowest and highest height, R32F otherwise
+	float scale{ 1.0f };
+	float offset{ 0.0f };
+};
+
+/* Upload the heights of heightfield into a new texture, requires a current OpenGL context.
+	16-bit height formats are stored as R16 spread between min_height and max_height, f32 as R32F. */
+Height_texture upload_height_texture(const Heightfield& heightfield, const float min_height, const float max_height);
+
+/* Copy the width*depth grid points starting at (x, z) from heightfield into texture with a single sub-upload,
+	used after the heights in that rectangle were edited. Heights outside the range of the texture are clamped. */
+void update_height_texture(const Height_texture& texture, const Heightfield& heightfield,
+	const size_t x, const size_t z, const size_t width, const size_t depth);
+
+/* Create a texture for heights of format, requires a current OpenGL context. target is GL_TEXTURE_2D or
+	GL_TEXTURE_2D_ARRAY with layers layers of width*width texels, the texture is left bound to target.
+	16-bit height formats are stored as R16 spread between min_height and max_height, f32 as R32F. */
+Height_texture create_height_texture(const GLenum target, const Height_format format, const float min_height,
+	const float max_height, const GLsizei width, const GLsizei layers);
+
+// Set the unpack alignment for uploading rows of height texels, returns the previous alignment for end_height_upload
+GLint begin_height_upload();
+
+// Restore the unpack alignment returned by begin_height_upload
+void end_height_upload(const GLint unpack_alignment);
+
+// Quantize count heights to the R16 texels of a unorm16 texture, heights outside its range are clamped
+void quantize_heights(const Height_texture& texture, const float* heights, const size_t count, uint16_t* out);
@@ -0,0 +1,409 @@
+/* Compact CPU-side terrain heights for collision and meshing */
+#include "heightfield.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+// GCC and Clang do not enable F16C with AVX2, MSVC has no F16C flag and enables it with /arch:AVX2
+#if defined(__F16C__) || (defined(_MSC_VER) && defined(__AVX2__))
+#define HEIGHTFIELD_F16C
+#endif
+#if defined(HEIGHTFIELD_F16C) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+// Convert a float to the nearest half float, rounding ties to even
+static uint16_t float_to_half(const float value)
+{
+#ifdef HEIGHTFIELD_F16C
+	return static_cast<uint16_t>(_cvtss_sh(value, 0));
+#else
+	uint32_t bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+	const uint32_t sign{ (bits >> 16) & 0x8000u };
+	const uint32_t magnitude{ bits & 0x7FFFFFFFu };
+	if (magnitude >= 0x7F800000u) // Infinity or NaN
+		return static_cast<uint16_t>(sign | 0x7C00u | (magnitude > 0x7F800000u ? 0x200u : 0u));
+	if (magnitude >= 0x477FF000u) // Rounds to more than the largest half float
+		return static_cast<uint16_t>(sign | 0x7C00u);
+	if (magnitude < 0x38800000u)
+	{
+		// Subnormal half, let the FPU round by adding 0.5f so the mantissa lines up with the half ulp
+		float shifted;
+		std::memcpy(&shifted, &magnitude, sizeof(shifted));
+		shifted += 0.5f;
+		uint32_t shifted_bits;
+		std::memcpy(&shifted_bits, &shifted, sizeof(shifted_bits));
+		return static_cast<uint16_t>(sign | (shifted_bits - 0x3F000000u));
+	}
+	// Normal half, rebias the exponent and round the dropped mantissa bits to nearest even
+	const uint32_t odd{ (magnitude >> 13) & 1u };
+	return static_cast<uint16_t>(sign | ((magnitude + 0xC8000FFFu + odd) >> 13));
+#endif
+}
+
+// Convert a half float to float, exact
+static float half_to_float(const uint16_t half)
+{
+#ifdef HEIGHTFIELD_F16C
+	return _cvtsh_ss(half);
+#else
+	const uint32_t sign{ (half & 0x8000u) << 16 };
+	const uint32_t exponent{ (half >> 10) & 0x1Fu };
+	const uint32_t mantissa{ half & 0x3FFu };
+	uint32_t bits;
+	if (exponent == 0x1Fu) // Infinity or NaN
+		bits = sign | 0x7F800000u | (mantissa << 13);
+	else if (exponent != 0)
+		bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+	else
+	{
+		// Zero or subnormal, mantissa * 2^-24 is exact in float
+		const float value{ static_cast<float>(mantissa) * (1.0f / 16777216.0f) };
+		std::memcpy(&bits, &value, sizeof(bits));
+		bits |= sign;
+	}
+	float value;
+	std::memcpy(&value, &bits, sizeof(value));
+	return value;
+#endif
+}
+
+// Parse "f32", "unorm16" or "f16", returns f32 for anything else
+Height_format parse_height_format(const std::string& name)
+{
+	if (name == "unorm16")
+		return Height_format::unorm16;
+	if (name == "f16")
+		return Height_format::f16;
+	if (name != "f32")
+		std::cerr << "parse_height_format: unknown height format '" << name << "', using f32\n";
+	return Height_format::f32;
+}
+
+// Store the width*width row-major heights (row = z, column = x) in the given format
+Heightfield::Heightfield(const float* heights, const unsigned int width, const float xz_scale, const Height_format format)
+	: grid_width(width), grid_scale(xz_scale), storage_format(format)
+{
+	const size_t count{ static_cast<size_t>(width) * width };
+	if (format == Height_format::f32)
+	{
+		heights32.assign(heights, heights + count);
+		return;
+	}
+
+	const auto [min_it, max_it] = std::minmax_element(heights, heights + count);
+	const float min_height{ count ? *min_it : 0.0f };
+	const float max_height{ count ? *max_it : 0.0f };
+	heights16.resize(count + 1);
+	if (format == Height_format::unorm16)
+	{
+		decode_scale = (max_height - min_height) / 65535.0f;
+		decode_offset = min_height;
+		const float encode_scale{ decode_scale > 0.0f ? 1.0f / decode_scale : 0.0f };
+		parallel_for(0, count, [&](const size_t first, const size_t last)
+			{
+				for (size_t i = first; i < last; i++)
+					heights16[i] = static_cast<uint16_t>(std::min(std::lround((heights[i] - min_height) * encode_scale), 65535l));
+			}, 1 << 16);
+	}
+	else
+	{
+		// Center the heights around zero, where half floats are most precise
+		decode_offset = (min_height + max_height) / 2;
+		parallel_for(0, count, [&](const size_t first, const size_t last)
+			{
+				for (size_t i = first; i < last; i++)
+					heights16[i] = float_to_half(heights[i] - decode_offset);
+			}, 1 << 16);
+	}
+}
+
+// Height of grid point (x, z), both must be less than width
+float Heightfield::at(const size_t x, const size_t z) const
+{
+	const size_t index{ x + z * grid_width };
+	switch (storage_format)
+	{
+	case Height_format::unorm16:
+		return heights16[index] * decode_scale + decode_offset;
+	case Height_format::f16:
+		return half_to_float(heights16[index]) + decode_offset;
+	default:
+		return heights32[index];
+	}
+}
+
+// Decode count heights starting at row-major index first into out
+void Heightfield::decode(const size_t first, const size_t count, float* out) const
+{
+	switch (storage_format)
+	{
+	case Height_format::unorm16:
+	{
+		const uint16_t* const in{ heights16.data() + first };
+		for (size_t i = 0; i < count; i++)
+			out[i] = in[i] * decode_scale + decode_offset;
+		break;
+	}
+	case Height_format::f16:
+	{
+		const uint16_t* const in{ heights16.data() + first };
+		size_t i{ 0 };
+#ifdef HEIGHTFIELD_F16C
+		// Convert eight halves per instruction
+		const __m256 offset{ _mm256_set1_ps(decode_offset) };
+		for (; i + 8 <= count; i += 8)
+		{
+			const __m256 values{ _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i))) };
+			_mm256_storeu_ps(out + i, _mm256_add_ps(values, offset));
+		}
+#endif
+		for (; i < count; i++)
+			out[i] = half_to_float(in[i]) + decode_offset;
+		break;
+	}
+	default:
+		std::copy_n(heights32.data() + first, count, out);
+		break;
+	}
+}
+
+// Number of points handled together by batched queries
+static constexpr size_t block_size{ 64 };
+
+struct Heightfield::Cell_block
+{
+	int32_t cx[block_size], cz[block_size]; // Grid column and row of the cell's (x, z) corner
+	float h00[block_size], h10[block_size], h01[block_size], h11[block_size]; // Corner heights, h10 is at (x+1, z)
+	float fx[block_size], fz[block_size]; // Position within the cell, in [0, 1]
+};
+
+// Height within a cell on the mesh triangle containing (fx, fz)
+static inline float triangle_height(const float h00, const float h10, const float h01, const float h11, const float fx, const float fz)
+{
+	if (fx + fz <= 1.0f)
+		return h00 + fx * (h10 - h00) + fz * (h01 - h00);
+	return h11 + (1.0f - fx) * (h01 - h11) + (1.0f - fz) * (h10 - h11);
+}
+
+// Height within a cell interpolated bilinearly between the corners
+static inline float bilinear_height(const float h00, const float h10, const float h01, const float h11, const float fx, const float fz)
+{
+	const float near_edge{ h00 + fx * (h10 - h00) };
+	const float far_edge{ h01 + fx * (h11 - h01) };
+	return near_edge + fz * (far_edge - near_edge);
+}
+
+// Height change per grid step in x and z on the mesh triangle containing (fx, fz)
+static inline void triangle_gradient(const float h00, const float h10, const float h01, const float h11, const float fx, const float fz,
+	float& dx, float& dz)
+{
+	const bool lower{ fx + fz <= 1.0f };
+	dx = lower ? h10 - h00 : h11 - h01;
+	dz = lower ? h01 - h00 : h11 - h10;
+}
+
+// Find the cell of one point and its corner heights
+void Heightfield::sample_cell(const float x, const float z, float (&corners)[4], float& fx, float& fz) const
+{
+	const float max_coord{ static_cast<float>(grid_width - 1) };
+	const float inv_scale{ 1.0f / grid_scale };
+	const float gx{ std::min(std::max(x * inv_scale, 0.0f), max_coord) };
+	const float gz{ std::min(std::max(z * inv_scale, 0.0f), max_coord) };
+	const size_t cx{ std::min(static_cast<size_t>(gx), static_cast<size_t>(grid_width - 2)) };
+	const size_t cz{ std::min(static_cast<size_t>(gz), static_cast<size_t>(grid_width - 2)) };
+	fx = gx - cx;
+	fz = gz - cz;
+	corners[0] = at(cx, cz);
+	corners[1] = at(cx + 1, cz);
+	corners[2] = at(cx, cz + 1);
+	corners[3] = at(cx + 1, cz + 1);
+}
+
+/* Find the cells of count <= block_size points and gather their corner heights.
+	Locating the cells vectorizes as is, the corners are fetched with AVX2 gathers when available and every height has
+	a 32-bit index. */
+void Heightfield::sample_cells(const float* xs, const float* zs, const size_t count, Cell_block& cells) const
+{
+	const float inv_scale{ 1.0f / grid_scale };
+	const float max_coord{ static_cast<float>(grid_width - 1) };
+	const int32_t max_cell{ static_cast<int32_t>(grid_width) - 2 };
+	const int32_t row{ static_cast<int32_t>(grid_width) };
+	for (size_t i = 0; i < count; i++)
+	{
+		const float gx{ std::min(std::max(xs[i] * inv_scale, 0.0f), max_coord) };
+		const float gz{ std::min(std::max(zs[i] * inv_scale, 0.0f), max_coord) };
+		const int32_t cx{ std::min(static_cast<int32_t>(gx), max_cell) };
+		const int32_t cz{ std::min(static_cast<int32_t>(gz), max_cell) };
+		cells.fx[i] = gx - cx;
+		cells.fz[i] = gz - cz;
+		cells.cx[i] = cx;
+		cells.cz[i] = cz;
+	}
+
+	size_t i{ 0 };
+#ifdef __AVX2__
+	// Gathers take 32-bit indices, grids with more heights than that use the scalar loop
+	const bool gather_32{ static_cast<size_t>(grid_width) * grid_width <= static_cast<size_t>(INT32_MAX) };
+	const __m256i next_row{ _mm256_set1_epi32(row) };
+	const __m256i next_col{ _mm256_set1_epi32(1) };
+	const auto corner_index = [&cells, next_row](const size_t first)
+		{
+			const __m256i cx{ _mm256_loadu_si256(reinterpret_cast<const __m256i*>(cells.cx + first)) };
+			const __m256i cz{ _mm256_loadu_si256(reinterpret_cast<const __m256i*>(cells.cz + first)) };
+			return _mm256_add_epi32(cx, _mm256_mullo_epi32(cz, next_row));
+		};
+	if (gather_32 && storage_format == Height_format::f32)
+	{
+		const float* const base{ heights32.data() };
+		for (; i + 8 <= count; i += 8)
+		{
+			const __m256i i00{ corner_index(i) };
+			const __m256i i01{ _mm256_add_epi32(i00, next_row) };
+			_mm256_storeu_ps(cells.h00 + i, _mm256_i32gather_ps(base, i00, 4));
+			_mm256_storeu_ps(cells.h10 + i, _mm256_i32gather_ps(base, _mm256_add_epi32(i00, next_col), 4));
+			_mm256_storeu_ps(cells.h01 + i, _mm256_i32gather_ps(base, i01, 4));
+			_mm256_storeu_ps(cells.h11 + i, _mm256_i32gather_ps(base, _mm256_add_epi32(i01, next_col), 4));
+		}
+	}
+	else if (gather_32 && storage_format == Height_format::unorm16)
+	{
+		// Gather 32 bits at each 16-bit height and keep the low half, the padding keeps the last read in bounds
+		const int* const base{ reinterpret_cast<const int*>(heights16.data()) };
+		const __m256i low_half{ _mm256_set1_epi32(0xFFFF) };
+		const __m256 scale{ _mm256_set1_ps(decode_scale) };
+		const __m256 offset{ _mm256_set1_ps(decode_offset) };
+		const auto gather_unorm16 = [&](const __m256i index)
+		{
+			const __m256i values{ _mm256_and_si256(_mm256_i32gather_epi32(base, index, 2), low_half) };
+			return _mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(values), scale), offset);
+		};
+		for (; i + 8 <= count; i += 8)
+		{
+			const __m256i i00{ corner_index(i) };
+			const __m256i i01{ _mm256_add_epi32(i00, next_row) };
+			_mm256_storeu_ps(cells.h00 + i, gather_unorm16(i00));
+			_mm256_storeu_ps(cells.h10 + i, gather_unorm16(_mm256_add_epi32(i00, next_col)));
+			_mm256_storeu_ps(cells.h01 + i, gather_unorm16(i01));
+			_mm256_storeu_ps(cells.h11 + i, gather_unorm16(_mm256_add_epi32(i01, next_col)));
+		}
+	}
+#endif
+	for (; i < count; i++)
+	{
+		const size_t cx{ static_cast<size_t>(cells.cx[i]) };
+		const size_t cz{ static_cast<size_t>(cells.cz[i]) };
+		cells.h00[i] = at(cx, cz);
+		cells.h10[i] = at(cx + 1, cz);
+		cells.h01[i] = at(cx, cz + 1);
+		cells.h11[i] = at(cx + 1, cz + 1);
+	}
+}
+
+// Height of the terrain surface at world position (x, z)
+float Heightfield::height(const float x, const float z, const Height_sampling sampling) const
+{
+	float corners[4];
+	float fx, fz;
+	sample_cell(x, z, corners, fx, fz);
+	if (sampling == Height_sampling::bilinear)
+		return bilinear_height(corners[0], corners[1], corners[2], corners[3], fx, fz);
+	return triangle_height(corners[0], corners[1], corners[2], corners[3], fx, fz);
+}
+
+// Unit normal of the mesh triangle at world position (x, z)
+glm::vec3 Heightfield::normal(const float x, const float z) const
+{
+	float corners[4];
+	float fx, fz;
+	sample_cell(x, z, corners, fx, fz);
+	float dx, dz;
+	triangle_gradient(corners[0], corners[1], corners[2], corners[3], fx, fz, dx, dz);
+	const float inv_scale{ 1.0f / grid_scale };
+	dx *= inv_scale;
+	dz *= inv_scale;
+	const float inv_length{ 1.0f / std::sqrt(dx * dx + dz * dz + 1.0f) };
+	return glm::vec3(-dx * inv_length, inv_length, -dz * inv_length);
+}
+
+// Steepness of the mesh triangle at world position (x, z) as rise over run
+float Heightfield::slope(const float x, const float z) const
+{
+	float corners[4];
+	float fx, fz;
+	sample_cell(x, z, corners, fx, fz);
+	float dx, dz;
+	triangle_gradient(corners[0], corners[1], corners[2], corners[3], fx, fz, dx, dz);
+	return std::sqrt(dx * dx + dz * dz) * (1.0f / grid_scale);
+}
+
+// Batched height queries, see height(x, z)
+void Heightfield::height(const float* xs, const float* zs, float* out, const size_t count, const Height_sampling sampling) const
+{
+	Cell_block cells;
+	for (size_t first = 0; first < count; first += block_size)
+	{
+		const size_t n{ std::min(block_size, count - first) };
+		sample_cells(xs + first, zs + first, n, cells);
+		float* const block_out{ out + first };
+		if (sampling == Height_sampling::bilinear)
+		{
+			for (size_t i = 0; i < n; i++)
+				block_out[i] = bilinear_height(cells.h00[i], cells.h10[i], cells.h01[i], cells.h11[i], cells.fx[i], cells.fz[i]);
+		}
+		else
+		{
+			for (size_t i = 0; i < n; i++)
+				block_out[i] = triangle_height(cells.h00[i], cells.h10[i], cells.h01[i], cells.h11[i], cells.fx[i], cells.fz[i]);
+		}
+	}
+}
+
+// Batched normal queries, see normal(x, z)
+void Heightfield::normal(const float* xs, const float* zs, glm::vec3* out, const size_t count) const
+{
+	Cell_block cells;
+	float nx[block_size], ny[block_size], nz[block_size];
+	const float inv_scale{ 1.0f / grid_scale };
+	for (size_t first = 0; first < count; first += block_size)
+	{
+		const size_t n{ std::min(block_size, count - first) };
+		sample_cells(xs + first, zs + first, n, cells);
+		for (size_t i = 0; i < n; i++)
+		{
+			float dx, dz;
+			triangle_gradient(cells.h00[i], cells.h10[i], cells.h01[i], cells.h11[i], cells.fx[i], cells.fz[i], dx, dz);
+			dx *= inv_scale;
+			dz *= inv_scale;
+			const float inv_length{ 1.0f / std::sqrt(dx * dx + dz * dz + 1.0f) };
+			nx[i] = -dx * inv_length;
+			ny[i] = inv_length;
+			nz[i] = -dz * inv_length;
+		}
+		for (size_t i = 0; i < n; i++)
+			out[first + i] = glm::vec3(nx[i], ny[i], nz[i]);
+	}
+}
+
+// Batched slope queries, see slope(x, z)
+void Heightfield::slope(const float* xs, const float* zs, float* out, const size_t count) const
+{
+	Cell_block cells;
+	const float inv_scale{ 1.0f / grid_scale };
+	for (size_t first = 0; first < count; first += block_size)
+	{
+		const size_t n{ std::min(block_size, count - first) };
+		sample_cells(xs + first, zs + first, n, cells);
+		for (size_t i = 0; i < n; i++)
+		{
+			float dx, dz;
+			triangle_gradient(cells.h00[i], cells.h10[i], cells.h01[i], cells.h11[i], cells.fx[i], cells.fz[i], dx, dz);
+			out[first + i] = std::sqrt(dx * dx + dz * dz) * inv_scale;
+		}
+	}
+}
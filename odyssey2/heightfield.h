@@ -0,0 +1,95 @@
+/* Compact CPU-side terrain heights for collision and meshing */
+#pragma once
+#include <glm/vec3.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Storage format of the heights in a Heightfield
+enum class Height_format
+{
+	f32, // 32-bit float, exact
+	unorm16, // 16-bit integer spread evenly between the lowest and highest point
+	f16 // 16-bit half float relative to the middle height, precision drops for heights far from it
+};
+
+// How heights between grid points are interpolated by Heightfield queries
+enum class Height_sampling
+{
+	triangle, // Linear over the two triangles of each cell, exactly on the rendered mesh
+	bilinear // Bilinear over the four corners of each cell, smoother but off the mesh inside cells
+};
+
+// Parse "f32", "unorm16" or "f16", returns f32 for anything else
+Height_format parse_height_format(const std::string& name);
+
+/* Square grid of terrain heights. x and z of a grid point are its column and row times xz_scale,
+	so only the heights are stored, optionally quantized to 16 bits. */
+class Heightfield
+{
+public:
+	Heightfield() = default;
+
+	// Store the width*width row-major heights (row = z, column = x) in the given format
+	Heightfield(const float* heights, const unsigned int width, const float xz_scale, const Height_format format);
+
+	// Height of grid point (x, z), both must be less than width
+	float at(const size_t x, const size_t z) const;
+
+	// Decode count heights starting at row-major index first into out
+	void decode(const size_t first, const size_t count, float* out) const;
+
+	/* Terrain queries at world position (x, z). The triangle split of each cell matches the rendered mesh:
+		(x, z), (x, z+1), (x+1, z) below the diagonal and (x+1, z), (x, z+1), (x+1, z+1) above it.
+		Positions outside the terrain are clamped to its edge. */
+
+	// Height of the terrain surface
+	float height(const float x, const float z, const Height_sampling sampling = Height_sampling::triangle) const;
+
+	// Unit normal of the mesh triangle
+	glm::vec3 normal(const float x, const float z) const;
+
+	// Steepness of the mesh triangle as rise over run, 0 is flat
+	float slope(const float x, const float z) const;
+
+	// Batched queries for count points at (xs[i], zs[i]), evaluated in blocks with SIMD gathers and arithmetic
+	void height(const float* xs, const float* zs, float* out, const size_t count,
+		const Height_sampling sampling = Height_sampling::triangle) const;
+	void normal(const float* xs, const float* zs, glm::vec3* out, const size_t count) const;
+	void slope(const float* xs, const float* zs, float* out, const size_t count) const;
+
+	// Number of grid points along one side
+	unsigned int width() const { return grid_width; }
+
+	// Distance between neighbouring grid points in x and z
+	float xz_scale() const { return grid_scale; }
+
+	Height_format format() const { return storage_format; }
+
+	// Bytes used by the stored heights
+	size_t memory_size() const { return heights32.size() * sizeof(float) + heights16.size() * sizeof(uint16_t); }
+
+private:
+	// Corner heights and position within the grid cell for a block of query points
+	struct Cell_block;
+
+	// Find the cells of count <= block size points and gather their corner heights
+	void sample_cells(const float* xs, const float* zs, const size_t count, Cell_block& cells) const;
+
+	// Find the cell of one point and its corner heights
+	void sample_cell(const float x, const float z, float (&corners)[4], float& fx, float& fz) const;
+
+	unsigned int grid_width{ 0 };
+	float grid_scale{ 1.0f };
+	Height_format storage_format{ Height_format::f32 };
+
+	// Only one of these is used, depending on storage_format. heights16 has one element of padding
+	// so batched queries can gather 32 bits at any height.
+	std::vector<float> heights32{};
+	std::vector<uint16_t> heights16{};
+
+	// height = stored value * decode_scale + decode_offset for unorm16, stored value + decode_offset for f16
+	float decode_scale{ 1.0f };
+	float decode_offset{ 0.0f };
+};
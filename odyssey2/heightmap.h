@@ -0,0 +1,79 @@
+/* Flat heightmap storage shared by terrain generation and filtering */
+#pragma once
+#include <cstddef>
+#include <new>
+#include <vector>
+
+// Allocator returning memory aligned to Alignment bytes, keeps heightmap rows SIMD and cache line aligned
+template <typename T, size_t Alignment = 64>
+struct Aligned_allocator
+{
+	using value_type = T;
+
+	template <typename U>
+	struct rebind
+	{
+		using other = Aligned_allocator<U, Alignment>;
+	};
+
+	Aligned_allocator() = default;
+
+	template <typename U>
+	Aligned_allocator(const Aligned_allocator<U, Alignment>&) noexcept
+	{
+	}
+
+	T* allocate(const size_t n)
+	{
+		return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(Alignment)));
+	}
+
+	void deallocate(T* p, size_t) noexcept
+	{
+		::operator delete(p, std::align_val_t(Alignment));
+	}
+
+	template <typename U>
+	bool operator==(const Aligned_allocator<U, Alignment>&) const noexcept
+	{
+		return true;
+	}
+
+	template <typename U>
+	bool operator!=(const Aligned_allocator<U, Alignment>&) const noexcept
+	{
+		return false;
+	}
+};
+
+// Square heightmap stored as one contiguous row-major buffer of width*width floats
+using Heightmap = std::vector<float, Aligned_allocator<float>>;
+
+// Wrap a row or column index into [0, width), used for toroidal heightmap lookups
+template <bool PowerOfTwo>
+struct Wrap
+{
+	explicit Wrap(const size_t width) : width(width) {}
+
+	size_t operator()(const size_t i) const { return i % width; }
+
+	const size_t width;
+};
+
+// Power-of-two widths wrap with a bit mask instead of a division
+template <>
+struct Wrap<true>
+{
+	explicit Wrap(const size_t width) : width(width), mask(width - 1) {}
+
+	size_t operator()(const size_t i) const { return i & mask; }
+
+	const size_t width;
+	const size_t mask;
+};
+
+// Return true if width is a nonzero power of two
+constexpr bool is_power_of_two(const size_t width)
+{
+	return width != 0 && (width & (width - 1)) == 0;
+}
@@ -1,14 +1,32 @@
 #include "callback.h"
 #include "camera.h"
+#include "frame_uniforms.h"
+#include "frustum.h"
 #include "io.h"
+#include "parallel.h"
 #include "shader.h"
 #include "terrain.h"
+#include "terrain_clipmap.h"
+#include "terrain_lod.h"
 #include "util_misc.h"
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
+#include <glm/gtc/matrix_inverse.hpp>
+#include <glm/mat3x3.hpp>
 #include <glm/mat4x4.hpp>
+#include <glm/trigonometric.hpp>
+#include <glm/vec2.hpp>
 #include <glm/vec3.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <future>
 #include <iostream>
+#include <string>
+#include <vector>
 
 struct Terrain_texture_ids
 {
@@ -42,7 +60,7 @@ static GLFWwindow* init_gl()
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 	glfwWindowHint(GLFW_SAMPLES, 2); // MSAA samples
 	glfwWindowHint(GLFW_DOUBLEBUFFER, GLFW_TRUE);
-	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE); // Don't show window until loading finished
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE); // Don't show window until OpenGL is initialized
 
 	unsigned requested_window_w{ read_value_from_ini("window_w", 1280u) };
 	unsigned requested_window_h{ read_value_from_ini("window_h", 720u) };
@@ -79,41 +97,63 @@ static GLFWwindow* init_gl()
 	return window;
 }
 
-// Set up terrain, skybox and water shaders
-// TODO: Move fog_color and textures to settings.ini
-static void init_graphics(Terrain_texture_ids& terrain_tex_ids,
-	std::vector<GLuint>& skybox_textures, Shader*& skybox_shader, Shader*& terrain_shader, Shader*& water_shader, const Terrain& terrain)
+// Set up terrain, skybox and water shaders and textures. Independent of the terrain, so it can run while
+// the terrain is generated. Textures are decoded on worker threads while the skybox and water shaders compile,
+// terrain shader variants depend on the terrain's materials and are compiled when they are first drawn.
+// Camera matrices and the fog colour are shared by all shaders through the Frame uniform block.
+// show_progress redraws the loading screen, it is called between the steps and while waiting for the textures.
+// TODO: Move textures to settings.ini
+static void init_graphics(const Terrain_render_path render_path, Terrain_texture_ids& terrain_tex_ids,
+	std::vector<GLuint>& skybox_textures, Shader*& skybox_shader, Shader*& terrain_shader, Shader*& water_shader,
+	const std::function<void()>& show_progress)
 {
-	const glm::vec3 fog_color{ glm::vec3(0.7, 0.7, 0.7) };
-
-	// Load terrain textures and upload to texture units
-	terrain_shader = new Shader("shader/terrain.vert", "shader/terrain.frag");
-	terrain_shader->use();
-	terrain_shader->load_stb_texture_ref("tex/snow_02_translucent.png", &terrain_tex_ids.snow_tex, false);
-	terrain_shader->load_stb_texture_ref("tex/burned_ground_01.png", &terrain_tex_ids.grass_tex, false);
-	terrain_shader->load_stb_texture_ref("tex/rock_06.png", &terrain_tex_ids.rock_tex, false);
-	terrain_shader->load_stb_texture_ref("tex/brown_mud_rocks_01.png", &terrain_tex_ids.bottom_tex, false);
+	// Start decoding terrain and skybox textures
+	const std::vector<std::string> terrain_tex_paths{
+		"tex/snow_02_translucent.png", "tex/burned_ground_01.png", "tex/rock_06.png", "tex/brown_mud_rocks_01.png"
+	};
+	std::future<std::vector<Decoded_image>> terrain_images{ std::async(std::launch::async, [&terrain_tex_paths]
+		{
+			std::vector<Decoded_image> images(terrain_tex_paths.size());
+			parallel_for(0, images.size(), [&](const size_t first, const size_t last)
+				{
+					for (size_t i = first; i < last; i++)
+						images[i] = decode_image(terrain_tex_paths[i]);
+				});
+			return images;
+		}) };
+	std::future<std::vector<std::vector<Decoded_image>>> skybox_images{ std::async(std::launch::async, decode_cubemaps) };
+	const auto wait = [&show_progress](const auto& future)
+		{
+			while (future.wait_for(std::chrono::milliseconds(10)) != std::future_status::ready)
+				show_progress();
+		};
+
+	// Set terrain texture units, the pull, cdlod, clipmap and tessellation render paths build their vertices from a
+	// heightmap texture. Tessellation adds control and evaluation shaders.
+	const char* terrain_vert_path{ "shader/terrain.vert" };
+	if (render_path == Terrain_render_path::pull)
+		terrain_vert_path = "shader/terrain_pull.vert";
+	else if (render_path == Terrain_render_path::cdlod)
+		terrain_vert_path = "shader/terrain_cdlod.vert";
+	else if (render_path == Terrain_render_path::clipmap)
+		terrain_vert_path = "shader/terrain_clipmap.vert";
+	constexpr uint32_t terrain_features{ shader_fog | shader_lod_colors | shader_terrain_materials };
+	if (render_path == Terrain_render_path::tessellation)
+		terrain_shader = new Shader("shader/terrain_tess.vert", "shader/terrain_tess.tesc", "shader/terrain_tess.tese", "shader/terrain.frag",
+			terrain_features);
+	else
+		terrain_shader = new Shader(terrain_vert_path, "shader/terrain.frag", terrain_features);
 	terrain_shader->set_int("snowTex", 0);
 	terrain_shader->set_int("grassTex", 1);
 	terrain_shader->set_int("rockTex", 2);
 	terrain_shader->set_int("bottomTex", 3);
-	terrain_shader->set_bool("drawFog", false);
-	terrain_shader->set_vec3("fogColor", fog_color);
-
-	// Set multitexturing height limits
-	const float terrain_height{ terrain.max_height - terrain.min_height };
-	terrain_shader->set_float("minHeight", terrain.min_height);
-	terrain_shader->set_float("maxHeight", terrain.max_height);
-	terrain_shader->set_float("seaHeight", terrain.sea_height);
-	terrain_shader->set_float("snowHeight", terrain.max_height - terrain_height / 3);
+	terrain_shader->set_int("heightTex", 4);
 
 	// Initialize skybox cubemap and vertices
-	skybox_shader = new Shader("shader/skybox.vert", "shader/skybox.frag");
+	skybox_shader = new Shader("shader/skybox.vert", "shader/skybox.frag", shader_fog);
 	skybox_shader->use();
-	skybox_shader->set_bool("drawFog", false);
-	skybox_shader->set_vec3("fogColor", fog_color);
-	load_cubemap(skybox_textures); // Load initial skybox
 	skybox_shader->set_int("skyboxTex", 0);
+	show_progress();
 
 	// Allocate and activate skybox VBO
 	const GLfloat skybox_vertices[]{
@@ -142,13 +182,80 @@ static void init_graphics(Terrain_texture_ids& terrain_tex_ids,
 	glEnableVertexAttribArray(0);
 	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), nullptr);
 
+	// Initialize water shader, the surface is added by init_terrain_graphics
+	water_shader = new Shader("shader/water.vert", "shader/water.frag", shader_fog | shader_extra_waves);
+	water_shader->use();
+	show_progress();
+
+	// Upload decoded textures
+	wait(terrain_images);
+	const std::vector<Decoded_image> images{ terrain_images.get() };
+	GLuint* const terrain_tex_refs[]{ &terrain_tex_ids.snow_tex, &terrain_tex_ids.grass_tex, &terrain_tex_ids.rock_tex, &terrain_tex_ids.bottom_tex };
+	for (size_t i = 0; i < images.size(); i++)
+	{
+		if (!images[i].data)
+			std::cerr << "Failed to load texture " << terrain_tex_paths[i] << std::endl;
+		Shader::load_texture(images[i], terrain_tex_refs[i], false);
+	}
+	show_progress();
+	wait(skybox_images);
+	load_cubemap(skybox_textures, skybox_images.get());
+	show_progress();
+}
+
+// Multitexturing height above which terrain.frag blends in snow
+static float snow_height(const Terrain& terrain)
+{
+	return terrain.max_height - (terrain.max_height - terrain.min_height) / 3;
+}
+
+/* Terrain materials (shader_terrain_materials) that terrain.frag draws between heights min and max. The range is
+	widened by a 16-bit height step, as quantized vertices and heightmap textures round heights by up to half of one. */
+static uint32_t terrain_materials(const Terrain& terrain, float min, float max)
+{
+	const float margin{ (terrain.max_height - terrain.min_height) / 65535.0f };
+	min -= margin;
+	max += margin;
+	const float shore{ terrain.sea_height + 1.0f }; // Lake bottom below, rock, grass and snow above
+	const float snow{ snow_height(terrain) };
+	uint32_t materials{ 0 };
+	if (min < shore)
+		materials |= shader_lake_bottom;
+	if (max >= shore)
+		materials |= shader_rock;
+	if (max >= shore && min < snow)
+		materials |= shader_grass;
+	if (max > snow)
+		materials |= shader_snow;
+	return materials;
+}
+
+// Set terrain dependent uniforms and build the water surface once the terrain is generated
+static void init_terrain_graphics(Shader* terrain_shader, Shader* water_shader, const Terrain& terrain)
+{
+	// Set multitexturing height limits
+	const float terrain_height{ terrain.max_height - terrain.min_height };
+	terrain_shader->set_float("minHeight", terrain.min_height);
+	terrain_shader->set_float("maxHeight", terrain.max_height);
+	terrain_shader->set_float("seaHeight", terrain.sea_height);
+	terrain_shader->set_float("snowHeight", snow_height(terrain));
+	terrain_shader->set_float("texScale", 1.0f / (4.0f * terrain.world_xz_scale)); // Four grid cells per texture repeat
+	terrain_shader->set_float("xzScale", terrain.world_xz_scale);
+	terrain_shader->set_float("heightScale", terrain.height_texture.scale);
+	terrain_shader->set_float("heightOffset", terrain.height_texture.offset);
+	if (terrain.vertex_format == Terrain_vertex_format::quantized)
+	{
+		terrain_shader->set_vec3("positionScale", terrain.world_xz_scale, terrain_height / 65535.0f, terrain.world_xz_scale);
+		terrain_shader->set_vec3("positionOffset", 0.0f, terrain.min_height, 0.0f);
+	}
+	else
+	{
+		terrain_shader->set_vec3("positionScale", 1.0f, 1.0f, 1.0f);
+		terrain_shader->set_vec3("positionOffset", 0.0f, 0.0f, 0.0f);
+	}
+
 	// Initialize water surface
 	const float world_total_size = terrain.world_xz_scale * (terrain.world_size - 1);
-	water_shader = new Shader("shader/water.vert", "shader/water.frag");
-	water_shader->use();
-	water_shader->set_bool("drawFog", false);
-	water_shader->set_bool("extraWaves", false);
-	water_shader->set_vec3("fogColor", fog_color);
 	water_shader->set_float("worldSize", world_total_size);
 
 	// Allocate and activate VAO/VBO
@@ -163,29 +270,93 @@ static void init_graphics(Terrain_texture_ids& terrain_tex_ids,
 		world_total_size, terrain.sea_height, world_total_size
 	};
 	unsigned int water_vbo;
+	glBindVertexArray(water_shader->vao);
 	glGenBuffers(1, &water_vbo);
 	glBindBuffer(GL_ARRAY_BUFFER, water_vbo);
 	glBufferData(GL_ARRAY_BUFFER, 2ull * 9ull * sizeof(GLfloat), water_surface_vert, GL_STATIC_DRAW);
-	glEnableVertexAttribArray(glGetAttribLocation(water_shader->id, "inPos"));
-	glVertexAttribPointer(glGetAttribLocation(water_shader->id, "inPos"), 3, GL_FLOAT, GL_FALSE, 0, 0);
+	glEnableVertexAttribArray(0); // inPos, at the same location in every variant of water_shader
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
+}
+
+// Draw a progress bar for terrain generation and show the progress in the window title
+static void draw_loading_screen(GLFWwindow* window, const float progress)
+{
+	int fb_w{}, fb_h{};
+	glfwGetFramebufferSize(window, &fb_w, &fb_h);
+	const int bar_w{ fb_w / 2 };
+	const int bar_h{ std::max(fb_h / 48, 4) };
+	const int bar_x{ (fb_w - bar_w) / 2 };
+	const int bar_y{ (fb_h - bar_h) / 2 };
+
+	// The bar is drawn by clearing scissor rectangles, so no shaders are needed
+	glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	glEnable(GL_SCISSOR_TEST);
+	glScissor(bar_x, bar_y, bar_w, bar_h);
+	glClearColor(0.3f, 0.3f, 0.3f, 1.0f);
+	glClear(GL_COLOR_BUFFER_BIT);
+	glScissor(bar_x, bar_y, static_cast<int>(bar_w * progress), bar_h);
+	glClearColor(0.7f, 0.7f, 0.7f, 1.0f);
+	glClear(GL_COLOR_BUFFER_BIT);
+	glDisable(GL_SCISSOR_TEST);
+	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+
+	const std::string title{ "Odyssey II - Generating terrain " + std::to_string(static_cast<int>(progress * 100)) + "%" };
+	glfwSetWindowTitle(window, title.c_str());
+	glfwSwapBuffers(window);
+	glfwPollEvents();
 }
 
 int main()
 {
 	std::cout << read_value_from_ini<std::string>("greeting", "");
 
-	// Initiate OpenGL and graphics
+	// Initiate OpenGL and show loading screen
 	GLFWwindow* window{ init_gl() };
+	glfwShowWindow(window);
+	std::atomic<float> terrain_progress{};
+	draw_loading_screen(window, terrain_progress);
 
-	// Generate terrain
+	// Generate terrain on a worker thread while graphics are initialized
 	const unsigned int world_size{ read_value_from_ini("world_size", 128u) };
 	const float world_xz_scale{ read_value_from_ini("world_xz_scale", 32.0f) };
-	const Terrain terrain{ world_size, world_xz_scale };
+	const Terrain_render_path render_path{ parse_terrain_render_path(read_value_from_ini<std::string>("terrain_renderer", "mesh")) };
+	std::future<Terrain> terrain_future{ std::async(std::launch::async, [&]
+		{
+			return Terrain{ world_size, world_xz_scale, render_path, &terrain_progress };
+		}) };
+
+	// Redraw the loading screen. Closing the window while loading exits right away, terrain generation can not be
+	// interrupted and ends with the process. std::_Exit skips static destructors, the generator threads may still use them.
+	const std::function<void()> show_progress{ [window, &terrain_progress]
+		{
+			if (glfwWindowShouldClose(window))
+			{
+				glfwDestroyWindow(window);
+				glfwTerminate();
+				std::cout.flush();
+				std::_Exit(EXIT_SUCCESS);
+			}
+			draw_loading_screen(window, terrain_progress);
+		} };
 
 	Shader *skybox_shader, *terrain_shader, *water_shader;
 	Terrain_texture_ids terrain_tex{};
 	std::vector<GLuint> skybox_textures;
-	init_graphics(terrain_tex, skybox_textures, skybox_shader, terrain_shader, water_shader, terrain);
+	init_graphics(render_path, terrain_tex, skybox_textures, skybox_shader, terrain_shader, water_shader, show_progress);
+
+	// Per-frame uniforms of all shaders, uploaded once per frame
+	const GLuint frame_buffer{ create_frame_uniform_buffer() };
+	Frame_uniforms frame{};
+	frame.fog_color = glm::vec3(0.7f, 0.7f, 0.7f); // TODO: Move to settings.ini
+
+	// Show progress until the terrain is generated, then upload it
+	while (terrain_future.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+		show_progress();
+	Terrain terrain{ terrain_future.get() };
+	terrain.upload();
+	init_terrain_graphics(terrain_shader, water_shader, terrain);
+	glfwSetWindowTitle(window, "Odyssey II");
 
 	// Initialize player camera
 	Camera camera(terrain.sea_height);
@@ -196,18 +367,76 @@ int main()
 	const float initial_xz_pos = terrain.world_size * terrain.world_xz_scale / 2.0f;
 	camera.position = glm::vec3(initial_xz_pos, terrain.max_height, initial_xz_pos);
 
-	// Give GLFW mouse pointer control and show window
+	// Give GLFW mouse pointer control
 	glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 	if (glfwRawMouseMotionSupported())
 		glfwSetInputMode(window, GLFW_RAW_MOUSE_MOTION, GLFW_TRUE);
-	glfwShowWindow(window);
 
-	// Save shader locations for terrain
-	GLint terr_vert_loc{ glGetAttribLocation(terrain_shader->id, "inPos") };
-	GLint terr_normal_loc{ glGetAttribLocation(terrain_shader->id, "inNormal") };
-	GLint terr_tex_loc{ glGetAttribLocation(terrain_shader->id, "inTexCoord") };
+	// Level of detail ranges for the cdlod render path
+	const Terrain_lod terrain_lod{ terrain.render_path == Terrain_render_path::cdlod ?
+		Terrain_lod{ terrain.heightfield, terrain.height_pyramid, read_value_from_ini("lod_pixel_error", 4.0f),
+			static_cast<float>(window_h), glm::radians(camera.cam_fov), camera.vp_far } :
+		Terrain_lod{} };
+
+	// Nested grids of the clipmap render path, their heights are uploaded as the camera moves
+	Terrain_clipmap terrain_clipmap{};
+	if (terrain.render_path == Terrain_render_path::clipmap)
+	{
+		terrain_clipmap = Terrain_clipmap{ terrain.heightfield, terrain.min_height, terrain.max_height, camera.vp_far };
+		terrain_shader->set_float("heightScale", terrain_clipmap.texture.scale);
+		terrain_shader->set_float("heightOffset", terrain_clipmap.texture.offset);
+		terrain_shader->set_int("coarsestLevel", static_cast<int>(terrain_clipmap.level_count() - 1));
+		terrain_shader->set_float("gridCells", static_cast<float>(Terrain_clipmap::grid_cells));
+		terrain_shader->set_float("morphCells", static_cast<float>(Terrain_clipmap::morph_cells));
+	}
+
+	// Projected edge length the tessellation render path aims for
+	if (terrain.render_path == Terrain_render_path::tessellation)
+	{
+		terrain_shader->set_float("viewportHeight", static_cast<float>(window_h));
+		terrain_shader->set_float("edgePixels", read_value_from_ini("lod_pixel_error", 4.0f));
+	}
+
+	/* Shader features toggled by F1, F2 and F4, and the terrain materials of terrain_shader's variants. The chunk
+		based render paths draw each chunk with the materials at its heights, the others with those of the whole terrain. */
+	uint32_t shader_features{ 0 };
+	const uint32_t all_terrain_materials{ terrain_materials(terrain, terrain.min_height, terrain.max_height) };
+	std::vector<uint32_t> chunk_materials(terrain.chunk_tree.chunk_count());
+	for (uint32_t chunk = 0; chunk < chunk_materials.size(); chunk++)
+	{
+		float min_height{};
+		float max_height{};
+		terrain.chunk_tree.height_range(chunk, min_height, max_height);
+		chunk_materials[chunk] = terrain_materials(terrain, min_height, max_height);
+	}
+
+	// Terrain uniforms set for every draw call of the cdlod and clipmap render paths, only their shaders have them
+	terrain_shader->use(all_terrain_materials);
+	Uniform<glm::vec3> node_uniform{};
+	Uniform<glm::vec2> morph_range_uniform{};
+	Uniform<glm::vec2> rect_origin_uniform{};
+	Uniform<glm::vec2> level_origin_uniform{};
+	Uniform<int> lod_level_uniform{};
+	if (terrain.render_path == Terrain_render_path::cdlod)
+	{
+		node_uniform = terrain_shader->uniform<glm::vec3>("node");
+		morph_range_uniform = terrain_shader->uniform<glm::vec2>("morphRange");
+		// Only used for the LOD colors, the variants without them may compile it out
+		lod_level_uniform = terrain_shader->optional_uniform<int>("lodLevel");
+	}
+	else if (terrain.render_path == Terrain_render_path::clipmap)
+	{
+		rect_origin_uniform = terrain_shader->uniform<glm::vec2>("rectOrigin");
+		level_origin_uniform = terrain_shader->uniform<glm::vec2>("levelOrigin");
+		lod_level_uniform = terrain_shader->uniform<int>("lodLevel");
+	}
 
 	// Main render loop
+	std::vector<uint32_t> visible_chunks; // Terrain chunks in the view frustum, reused every frame
+	std::vector<Lod_node> lod_nodes; // Terrain nodes selected by terrain_lod, reused every frame
+	std::vector<Clipmap_rect> clipmap_rects; // Rectangles of terrain_clipmap in the view frustum, reused every frame
+	std::vector<GLint> patch_firsts; // First vertex of each visible tessellation patch, reused every frame
+	std::vector<GLsizei> patch_counts;
 	double last_time{};
 	unsigned int skybox_index{};
 	while (!glfwWindowShouldClose(window))
@@ -216,33 +445,24 @@ int main()
 		double current_time{ glfwGetTime() };
 		double delta_time{ current_time - last_time };
 		last_time = current_time;
-		camera.process_keyboard(terrain.terrain_model->vertexArray, terrain.world_xz_scale, delta_time); // Update player state
-		// Toggle fog
+		camera.process_keyboard(terrain.heightfield, delta_time); // Update player state
+		// Toggle fog, wave amount and level of detail colours. Shaders switch to the variants with the
+		// new features when they are next used.
 		if (camera.key_state[GLFW_KEY_F1] == GLFW_PRESS)
 		{
-			static bool draw_fog = false;
-
-			draw_fog = !draw_fog;
-			terrain_shader->use();
-			terrain_shader->set_bool("drawFog", draw_fog);
-			skybox_shader->use();
-			skybox_shader->set_bool("drawFog", draw_fog);
-			water_shader->use();
-			water_shader->set_bool("drawFog", draw_fog);
+			shader_features ^= shader_fog;
 			camera.key_state[GLFW_KEY_F1] = GLFW_REPEAT;
 		}
-		// Toggle wave amount
 		if (camera.key_state[GLFW_KEY_F2] == GLFW_PRESS)
 		{
-			static bool extra_waves = false;
-
-			extra_waves = !extra_waves;
-			water_shader->use();
-			// TODO: Would it be more performant to switch shaders here based on
-			// extra_waves instead of checking a boolean inside the shader?
-			water_shader->set_bool("extraWaves", extra_waves);
+			shader_features ^= shader_extra_waves;
 			camera.key_state[GLFW_KEY_F2] = GLFW_REPEAT;
 		}
+		if (camera.key_state[GLFW_KEY_F4] == GLFW_PRESS)
+		{
+			shader_features ^= shader_lod_colors;
+			camera.key_state[GLFW_KEY_F4] = GLFW_REPEAT;
+		}
 
 		// Print FPS once every second
 		if constexpr (constexpr bool print_fps{ false }; print_fps)
@@ -260,12 +480,23 @@ int main()
 			}
 		}
 
+		// Update the uniforms shared by all shaders
+		const glm::mat4 world_to_view{ camera.get_view_matrix() };
+		frame.world_to_view = world_to_view;
+		frame.projection = camera.projection;
+		frame.sky_world_to_view = glm::mat4(glm::mat3(world_to_view)); // Remove translation from the view matrix
+		frame.normal_matrix = glm::mat4(glm::inverseTranspose(glm::mat3(world_to_view)));
+		frame.camera_position = camera.position;
+		frame.time = static_cast<float>(current_time);
+		update_frame_uniform_buffer(frame_buffer, frame);
+		const Frustum view_frustum{ extract_frustum(camera.projection * world_to_view) };
+
 		// Clear screen and depth buffer
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
 		// --------- Draw skybox ---------
 		glDepthMask(GL_FALSE); // Disable depth writes
-		skybox_shader->use();
+		skybox_shader->use(shader_features);
 		glBindVertexArray(skybox_shader->vao);
 		glActiveTexture(GL_TEXTURE0);
 		// Change skybox texture
@@ -276,15 +507,11 @@ int main()
 		}
 		glBindTexture(GL_TEXTURE_CUBE_MAP, skybox_textures[skybox_index]);
 
-		glm::mat4 world_to_view{ glm::mat4(glm::mat3(camera.get_view_matrix())) }; // Remove translation from the view matrix
-		skybox_shader->set_mat4_f("worldToView", world_to_view);
-		skybox_shader->set_mat4_f("projection", camera.projection);
-
 		glDrawArrays(GL_TRIANGLES, 0, 36);
 		glDepthMask(GL_TRUE);
 
 		// --------- Draw terrain ---------
-		terrain_shader->use();
+		terrain_shader->use(shader_features | all_terrain_materials);
 		glActiveTexture(GL_TEXTURE0);
 		glBindTexture(GL_TEXTURE_2D, terrain_tex.snow_tex);
 		glActiveTexture(GL_TEXTURE1);
@@ -294,36 +521,95 @@ int main()
 		glActiveTexture(GL_TEXTURE3);
 		glBindTexture(GL_TEXTURE_2D, terrain_tex.bottom_tex);
 
-		terrain_shader->set_mat4_f("worldToView", camera.get_view_matrix());
-		terrain_shader->set_mat4_f("projection", camera.projection);
-
-		glBindVertexArray(terrain.terrain_model->vao);
-		glBindBuffer(GL_ARRAY_BUFFER, terrain.terrain_model->vb);
-
-		glVertexAttribPointer(terr_vert_loc, 3, GL_FLOAT, GL_FALSE, 0, 0);
-		glEnableVertexAttribArray(terr_vert_loc);
-
-		// Normals
-		glBindBuffer(GL_ARRAY_BUFFER, terrain.terrain_model->nb);
-		glVertexAttribPointer(terr_normal_loc, 3, GL_FLOAT, GL_FALSE, 0, 0);
-		glEnableVertexAttribArray(terr_normal_loc);
-
-		// VBO for texture coordinate data
-		glBindBuffer(GL_ARRAY_BUFFER, terrain.terrain_model->tb);
-		glVertexAttribPointer(terr_tex_loc, 2, GL_FLOAT, GL_FALSE, 0, 0);
-		glEnableVertexAttribArray(terr_tex_loc);
-
-		glDrawElements(GL_TRIANGLES, terrain.terrain_model->numIndices, GL_UNSIGNED_INT, 0L);
+		if (terrain.render_path == Terrain_render_path::pull)
+		{
+			// One triangle strip per row of cells, the vertex shader reads everything from the heightmap texture
+			glActiveTexture(GL_TEXTURE4);
+			glBindTexture(GL_TEXTURE_2D, terrain.height_texture.id);
+			glBindVertexArray(terrain_shader->vao); // Empty VAO, there are no vertex attributes
+			glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, static_cast<GLsizei>(2 * terrain.world_size), static_cast<GLsizei>(terrain.world_size - 1));
+		}
+		else if (terrain.render_path == Terrain_render_path::cdlod)
+		{
+			// One draw per selected node, its rows are instances like on the pull path
+			terrain_lod.select(terrain.heightfield, terrain.height_pyramid, camera.position,
+				view_frustum, lod_nodes);
+			glActiveTexture(GL_TEXTURE4);
+			glBindTexture(GL_TEXTURE_2D, terrain.height_texture.id);
+			glBindVertexArray(terrain_shader->vao); // Empty VAO, there are no vertex attributes
+			for (const Lod_node& node : lod_nodes)
+			{
+				terrain_shader->set(node_uniform, glm::vec3(static_cast<float>(node.x), static_cast<float>(node.z), static_cast<float>(1u << node.level)));
+				terrain_shader->set(morph_range_uniform, glm::vec2(terrain_lod.morph_start(node.level), terrain_lod.morph_end(node.level)));
+				terrain_shader->set(lod_level_uniform, static_cast<int>(node.level));
+				glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, static_cast<GLsizei>(2 * (node.cells + 1)), static_cast<GLsizei>(node.cells));
+			}
+		}
+		else if (terrain.render_path == Terrain_render_path::clipmap)
+		{
+			// Upload the heights that came into view, then draw the rectangles of each level's ring
+			// with their rows as instances like on the pull path
+			terrain_clipmap.update(terrain.heightfield, camera.position);
+			terrain_clipmap.select(terrain.heightfield, view_frustum, clipmap_rects);
+			glActiveTexture(GL_TEXTURE4);
+			glBindTexture(GL_TEXTURE_2D_ARRAY, terrain_clipmap.texture.id);
+			glBindVertexArray(terrain_shader->vao); // Empty VAO, there are no vertex attributes
+			for (const Clipmap_rect& rect : clipmap_rects)
+			{
+				terrain_shader->set(rect_origin_uniform, glm::vec2(static_cast<float>(rect.x), static_cast<float>(rect.z)));
+				terrain_shader->set(level_origin_uniform, glm::vec2(static_cast<float>(terrain_clipmap.origin_x(rect.level)),
+					static_cast<float>(terrain_clipmap.origin_z(rect.level))));
+				terrain_shader->set(lod_level_uniform, static_cast<int>(rect.level));
+				glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, static_cast<GLsizei>(2 * (rect.cells_x + 1)), static_cast<GLsizei>(rect.cells_z));
+			}
+		}
+		else if (terrain.render_path == Terrain_render_path::tessellation)
+		{
+			// Draw the patches in the view frustum with one call per set of materials, each patch is its four corner vertices
+			terrain.chunk_tree.cull(view_frustum, visible_chunks);
+			std::sort(visible_chunks.begin(), visible_chunks.end(),
+				[&chunk_materials](const uint32_t a, const uint32_t b) { return chunk_materials[a] < chunk_materials[b]; });
+			glActiveTexture(GL_TEXTURE4);
+			glBindTexture(GL_TEXTURE_2D, terrain.height_texture.id);
+			glBindVertexArray(terrain.terrain_model->vao); // Corner attributes were set up by upload_terrain_patches
+			glPatchParameteri(GL_PATCH_VERTICES, 4);
+			for (size_t first = 0; first < visible_chunks.size();)
+			{
+				const uint32_t materials{ chunk_materials[visible_chunks[first]] };
+				patch_firsts.clear();
+				for (; first < visible_chunks.size() && chunk_materials[visible_chunks[first]] == materials; first++)
+					patch_firsts.push_back(terrain.chunks[visible_chunks[first]].first_vertex);
+				patch_counts.resize(patch_firsts.size(), 4);
+				terrain_shader->use(shader_features | materials);
+				glMultiDrawArrays(GL_PATCHES, patch_firsts.data(), patch_counts.data(), static_cast<GLsizei>(patch_firsts.size()));
+			}
+		}
+		else
+		{
+			// Draw the chunks in the view frustum, grouped by the variant for their materials. Chunks share the
+			// 16-bit indices of their size, the base vertex selects their vertices.
+			terrain.chunk_tree.cull(view_frustum, visible_chunks);
+			std::sort(visible_chunks.begin(), visible_chunks.end(),
+				[&chunk_materials](const uint32_t a, const uint32_t b) { return chunk_materials[a] < chunk_materials[b]; });
+			glBindVertexArray(terrain.terrain_model->vao); // Vertex attributes were set up by upload_terrain_mesh
+			uint32_t materials{ all_terrain_materials }; // Of the variant in use
+			for (const uint32_t chunk_index : visible_chunks)
+			{
+				if (chunk_materials[chunk_index] != materials)
+				{
+					materials = chunk_materials[chunk_index];
+					terrain_shader->use(shader_features | materials);
+				}
+				const Terrain_chunk& chunk{ terrain.chunks[chunk_index] };
+				glDrawElementsBaseVertex(GL_TRIANGLES, chunk.index_count, GL_UNSIGNED_SHORT,
+					reinterpret_cast<const void*>(chunk.first_index * sizeof(GLushort)), chunk.first_vertex);
+			}
+		}
 
 		// --------- Draw water surface ---------
-		water_shader->use();
+		water_shader->use(shader_features);
 		glBindVertexArray(water_shader->vao);
 
-		water_shader->set_mat4_f("worldToView", camera.get_view_matrix());
-		water_shader->set_mat4_f("projection", camera.projection);
-		water_shader->set_vec3("cameraPos", camera.position);
-		water_shader->set_float("time", static_cast<float>(glfwGetTime()));
-
 		glDrawArrays(GL_TRIANGLES, 0, 6); // API_ID_RECOMPILE_FRAGMENT_SHADER on (only) first call
 
 		glfwSwapBuffers(window);
@@ -0,0 +1,88 @@
+/* Read-only memory mapped files */
+#include "mapped_file.h"
+#include <string>
+#include <utility>
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/* Map the whole file read-only. The file and mapping handles are closed right away,
+	the view keeps the file mapped until unmap(). */
+Mapped_file::Mapped_file(const std::string& filename)
+{
+#ifdef _WIN32
+	const HANDLE file{ CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr) };
+	if (file == INVALID_HANDLE_VALUE)
+		return;
+	LARGE_INTEGER file_size{};
+	if (GetFileSizeEx(file, &file_size) && file_size.QuadPart > 0)
+	{
+		const HANDLE mapping{ CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr) };
+		if (mapping)
+		{
+			bytes = static_cast<const unsigned char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+			if (bytes)
+				length = static_cast<size_t>(file_size.QuadPart);
+			CloseHandle(mapping);
+		}
+	}
+	CloseHandle(file);
+#else
+	const int fd{ open(filename.c_str(), O_RDONLY) };
+	if (fd < 0)
+		return;
+	struct stat file_stat{};
+	if (fstat(fd, &file_stat) == 0 && file_stat.st_size > 0)
+	{
+		void* const mapping{ mmap(nullptr, static_cast<size_t>(file_stat.st_size), PROT_READ, MAP_PRIVATE, fd, 0) };
+		if (mapping != MAP_FAILED)
+		{
+			bytes = static_cast<const unsigned char*>(mapping);
+			length = static_cast<size_t>(file_stat.st_size);
+		}
+	}
+	close(fd);
+#endif
+}
+
+Mapped_file::~Mapped_file()
+{
+	unmap();
+}
+
+Mapped_file::Mapped_file(Mapped_file&& other) noexcept
+	: bytes(std::exchange(other.bytes, nullptr)), length(std::exchange(other.length, 0))
+{
+}
+
+Mapped_file& Mapped_file::operator=(Mapped_file&& other) noexcept
+{
+	if (this != &other)
+	{
+		unmap();
+		bytes = std::exchange(other.bytes, nullptr);
+		length = std::exchange(other.length, 0);
+	}
+	return *this;
+}
+
+// Unmap the file, the object is empty afterwards
+void Mapped_file::unmap()
+{
+	if (!bytes)
+		return;
+#ifdef _WIN32
+	UnmapViewOfFile(bytes);
+#else
+	munmap(const_cast<unsigned char*>(bytes), length);
+#endif
+	bytes = nullptr;
+	length = 0;
+}
@@ -0,0 +1,26 @@
+/* Read-only memory mapped files */
+#pragma once
+#include <cstddef>
+#include <string>
+
+// Read-only memory mapping of a whole file, unmapped on destruction. Empty if the file could not be mapped.
+class Mapped_file
+{
+public:
+	Mapped_file() = default;
+	explicit Mapped_file(const std::string& filename);
+	~Mapped_file();
+	Mapped_file(Mapped_file&& other) noexcept;
+	Mapped_file& operator=(Mapped_file&& other) noexcept;
+	Mapped_file(const Mapped_file&) = delete;
+	Mapped_file& operator=(const Mapped_file&) = delete;
+
+	const unsigned char* data() const { return bytes; }
+	size_t size() const { return length; }
+
+private:
+	void unmap();
+
+	const unsigned char* bytes{ nullptr };
+	size_t length{ 0 };
+};
@@ -1,23 +1,21 @@
 #pragma once
 #include <glad/glad.h>
-#include <vector>
 
 // Data container for terrain model
 struct Model
 {
-	// Construct Model with full set of vectors
-	Model(std::vector<GLfloat> vertexArray, GLsizei numVertices, GLsizei numIndices)
-		: vertexArray(std::move(vertexArray)), numVertices(numVertices), numIndices(numIndices),
-		  vao(0), vb(0), ib(0), nb(0), tb(0)
+	// Construct Model for numVertices vertices drawn with numIndices indices, buffers are created by the caller
+	Model(GLsizei numVertices, GLsizei numIndices)
+		: numVertices(numVertices), numIndices(numIndices),
+		  vao(0), vb(0), ib(0)
 	{
 	}
 
-	// Vertex data is needed on CPU for terrain collision, rest is GPU only
-	std::vector<GLfloat> vertexArray;
+	// Model data is GPU only, terrain collision uses the Terrain's Heightfield
 	GLsizei numVertices;
 	GLsizei numIndices;
 
 	// VBO and VAO IDs
 	GLuint vao;
-	GLuint vb, ib, nb, tb; // VBOs
+	GLuint vb, ib; // Interleaved vertex and index VBOs
 };
@@ -0,0 +1,46 @@
+/* Minimal helpers for splitting data parallel work over worker threads */
+#pragma once
+#include "io.h"
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+// Number of worker threads to use, read once from settings.ini (0 = one per hardware thread)
+inline unsigned int worker_count()
+{
+	static const unsigned int count = []
+	{
+		const unsigned int requested{ read_value_from_ini("threads", 0u) };
+		if (requested != 0)
+			return requested;
+		return std::max(std::thread::hardware_concurrency(), 1u);
+	}();
+	return count;
+}
+
+/* Split [begin, end) into one contiguous range per worker and call fn(range_begin, range_end) for each
+	range. The last range is run on the calling thread. Ranges are never smaller than min_grain items,
+	so small workloads run single threaded without spawning any threads. */
+template <typename Func>
+void parallel_for(const size_t begin, const size_t end, Func&& fn, const size_t min_grain = 1)
+{
+	if (end <= begin)
+		return;
+	const size_t count{ end - begin };
+	const size_t max_ranges{ std::max<size_t>(count / std::max<size_t>(min_grain, 1), 1) };
+	const size_t num_ranges{ std::min<size_t>(worker_count(), max_ranges) };
+	const size_t range_size{ (count + num_ranges - 1) / num_ranges };
+
+	std::vector<std::thread> workers;
+	workers.reserve(num_ranges - 1);
+	size_t range_begin{ begin };
+	for (size_t i = 0; i + 1 < num_ranges && range_begin + range_size < end; i++)
+	{
+		workers.emplace_back(fn, range_begin, range_begin + range_size);
+		range_begin += range_size;
+	}
+	fn(range_begin, end);
+
+	for (auto& worker : workers)
+		worker.join();
+}
@@ -0,0 +1,122 @@
+/* Persistent on-disk cache of linked shader program binaries */
+#include "program_cache.h"
+#include "cache_file.h"
+#include "mapped_file.h"
+#include <cstring>
+#include <iostream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Bump whenever the file layout changes, old files are then recompiled
+static constexpr uint32_t cache_version{ 1 };
+static constexpr char cache_magic[8]{ 'O', 'D', 'Y', '2', 'P', 'R', 'O', 'G' };
+
+/* Fixed size header at the start of a cache file, followed by the program binary. Binaries are only valid for the
+	driver that wrote them, which is part of the key. */
+struct Cache_header
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t binary_format; // GLenum passed to glProgramBinary
+	uint64_t key;
+	uint64_t binary_size; // Size in bytes
+};
+
+// Path of the cache file for key, in the cache directory next to settings.ini
+static std::string program_cache_filename(const uint64_t key)
+{
+	return cache_filename("program", key);
+}
+
+/* True if the driver can save and load program binaries, which needs OpenGL 4.1 and at least one binary format.
+	Requires a current OpenGL context. */
+bool program_cache_supported()
+{
+	if (!GLAD_GL_VERSION_4_1)
+		return false;
+	GLint format_count{};
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &format_count);
+	return format_count > 0;
+}
+
+/* 64-bit FNV-1a hash of the cache format version, the OpenGL vendor, renderer and version strings and the final
+	source code of each of stage_count stages, including #define lines of variant features. Empty stages are skipped. */
+uint64_t program_cache_key(const std::string* stage_code, const size_t stage_count)
+{
+	uint64_t hash{ fnv1a_offset_basis };
+	fnv1a(hash, &cache_version, sizeof(cache_version));
+	for (const GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION })
+		fnv1a(hash, reinterpret_cast<const char*>(glGetString(name)));
+	for (size_t i = 0; i < stage_count; i++)
+	{
+		const uint64_t stage{ i };
+		fnv1a(hash, &stage, sizeof(stage));
+		fnv1a(hash, stage_code[i].c_str());
+	}
+	return hash;
+}
+
+/* Load the binary cached for key into program, a new program object without shaders. Returns false if the file is
+	missing, corrupt or not accepted by the driver, in which case the program must be compiled and linked. */
+bool load_program_cache(const uint64_t key, const GLuint program)
+{
+	const std::string filename{ program_cache_filename(key) };
+	const Mapped_file file{ filename };
+	if (!file.data())
+		return false; // Not compiled yet
+
+	Cache_header header{};
+	if (file.size() < sizeof(header))
+	{
+		std::cerr << "load_program_cache: ignoring truncated file " << filename << "\n";
+		return false;
+	}
+	std::memcpy(&header, file.data(), sizeof(header));
+	if (std::memcmp(header.magic, cache_magic, sizeof(cache_magic)) != 0 || header.version != cache_version ||
+		header.key != key || header.binary_size != file.size() - sizeof(header) || header.binary_size > INT32_MAX)
+	{
+		std::cerr << "load_program_cache: ignoring corrupt file " << filename << "\n";
+		return false;
+	}
+
+	// The driver checks the binary itself, it rejects binaries of other driver builds or hardware
+	glProgramBinary(program, header.binary_format, file.data() + sizeof(header), static_cast<GLsizei>(header.binary_size));
+	GLint success{};
+	glGetProgramiv(program, GL_LINK_STATUS, &success);
+	if (!success)
+	{
+		std::cerr << "load_program_cache: driver rejected " << filename << ", recompiling\n";
+		return false;
+	}
+	return true;
+}
+
+/* Write the binary of the linked program to the cache file for key. The program should have been linked with
+	GL_PROGRAM_BINARY_RETRIEVABLE_HINT set. The file is written under a temporary name and renamed when complete,
+	so a partially written file is never loaded. */
+void save_program_cache(const uint64_t key, const GLuint program)
+{
+	GLint binary_length{};
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &binary_length);
+	if (binary_length <= 0)
+		return; // The driver does not provide a binary for this program
+	std::vector<unsigned char> binary(static_cast<size_t>(binary_length));
+	GLsizei length{};
+	GLenum format{};
+	glGetProgramBinary(program, binary_length, &length, &format, binary.data());
+	if (length <= 0)
+		return;
+
+	Cache_header header{};
+	std::memcpy(header.magic, cache_magic, sizeof(cache_magic));
+	header.version = cache_version;
+	header.binary_format = format;
+	header.key = key;
+	header.binary_size = static_cast<uint64_t>(length);
+	write_cache_file(program_cache_filename(key), [&header, &binary, length](std::ostream& out)
+		{
+			out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+			out.write(reinterpret_cast<const char*>(binary.data()), length);
+		}, "save_program_cache");
+}
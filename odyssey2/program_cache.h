@@ -0,0 +1,22 @@
+/* Persistent on-disk cache of linked shader program binaries */
+#pragma once
+#include <glad/glad.h>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/* True if the driver can save and load program binaries, which needs OpenGL 4.1 and at least one binary format.
+	Requires a current OpenGL context. */
+bool program_cache_supported();
+
+/* 64-bit FNV-1a hash of the cache format version, the OpenGL vendor, renderer and version strings and the final
+	source code of each of stage_count stages, including #define lines of variant features. Empty stages are skipped. */
+uint64_t program_cache_key(const std::string* stage_code, const size_t stage_count);
+
+/* Load the binary cached for key into program, a new program object without shaders. Returns false if the file is
+	missing, corrupt or not accepted by the driver, in which case the program must be compiled and linked. */
+bool load_program_cache(const uint64_t key, const GLuint program);
+
+/* Write the binary of the linked program to the cache file for key. The program should have been linked with
+	GL_PROGRAM_BINARY_RETRIEVABLE_HINT set. */
+void save_program_cache(const uint64_t key, const GLuint program);
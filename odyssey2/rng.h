@@ -0,0 +1,30 @@
+/* Stateless counter-based random numbers for terrain generation */
+#pragma once
+#include <cstdint>
+
+// SplitMix64 finalizer, maps a 64-bit counter to a well mixed 64-bit value
+constexpr uint64_t splitmix64(uint64_t x)
+{
+	x += 0x9E3779B97F4A7C15ull;
+	x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+	x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+	return x ^ (x >> 31);
+}
+
+// Hash the key (seed, step, row, col) into 64 random bits. row and col must fit in 32 bits each.
+constexpr uint64_t hash_cell(const uint32_t seed, const uint32_t step, const uint64_t row, const uint64_t col)
+{
+	const uint64_t h = splitmix64((static_cast<uint64_t>(seed) << 32) | step);
+	return splitmix64(h ^ ((row << 32) | col));
+}
+
+/* Return a random float number between min and max for the cell (row, col) at diamond-square step length step.
+	The result only depends on the key and uses exact integer to float conversion, so it is the same
+	regardless of evaluation order, thread and platform. */
+inline float hash_randnum(const uint32_t seed, const uint32_t step, const uint64_t row, const uint64_t col,
+	const float max, const float min)
+{
+	// The upper 24 bits fit exactly in a float mantissa, giving a uniform number in [0, 1)
+	const float unit = static_cast<float>(hash_cell(seed, step, row, col) >> 40) * (1.0f / 16777216.0f);
+	return (max - min) * unit + min;
+}
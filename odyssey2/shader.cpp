@@ -1,5 +1,11 @@
 #include "shader.h"
-#include "stb_image.h"
+#include "frame_uniforms.h"
+#include "io.h"
+#include "program_cache.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
 #include <glad/glad.h>
 #include <glm/gtc/type_ptr.hpp>
@@ -8,118 +14,364 @@
 #include <iostream>
 #include <sstream>
 #include <string>
+#include <utility>
 
-// Shader utility class, based on code by Joey de Vries: https://learnopengl.com/Getting-started/Shaders
-Shader::Shader(const char* vertex_path, const char* fragment_path)
-{
-	glGenVertexArrays(1, &this->vao);
-	glBindVertexArray(this->vao);
+// Deepest nesting of #include directives in shader files
+static constexpr int max_include_depth{ 8 };
 
-	// Retrieve the vertex/fragment source code from filePath
-	std::string vertex_code;
-	std::string fragment_code;
-	std::ifstream v_shader_file;
-	std::ifstream f_shader_file;
+/* Read the source code of the shader file at path into code, returns false if the file could not be read.
+	A line #include "file" is replaced by the code of file, relative to the directory of path, and followed by
+	a #line directive so compile errors still report the line numbers of path. */
+static bool read_shader_file(const std::string& path, std::string& code, const int include_depth = 0)
+{
+	std::ifstream shader_file;
+	std::string source;
 	// ensure ifstream objects can throw exceptions for below catch clauses
 	// failbit checks supposedly failed previously, might want to test this more
-	v_shader_file.exceptions(std::ifstream::badbit | std::ifstream::failbit);
-	f_shader_file.exceptions(std::ifstream::badbit | std::ifstream::failbit);
-
+	shader_file.exceptions(std::ifstream::badbit | std::ifstream::failbit);
 	try
 	{
-		v_shader_file.open(vertex_path);
-		std::stringstream v_shader_stream;
-		v_shader_stream << v_shader_file.rdbuf();
-		v_shader_file.close();
-		vertex_code = v_shader_stream.str();
+		shader_file.open(path);
+		std::stringstream shader_stream;
+		shader_stream << shader_file.rdbuf();
+		shader_file.close();
+		source = shader_stream.str();
 	}
 	catch (const std::ifstream::failure& e)
 	{
-		std::cerr << "Failed to open shader " << vertex_path << ": " << e.what() << std::endl;
+		std::cerr << "Failed to open shader " << path << ": " << e.what() << std::endl;
 		// TODO: Throw an exception or set a fail flag here to indicate shader loading failure
-		return;
+		return false;
 	}
 
-	try
+	const std::string directory{ path.substr(0, path.find_last_of("/\\") + 1) };
+	std::istringstream lines{ source };
+	std::ostringstream expanded;
+	std::string line;
+	for (int line_number = 1; std::getline(lines, line); line_number++)
 	{
-		f_shader_file.open(fragment_path);
-		std::stringstream f_shader_stream;
-		f_shader_stream << f_shader_file.rdbuf();
-		f_shader_file.close();
-		fragment_code = f_shader_stream.str();
+		const size_t first{ line.find_first_not_of(" \t") };
+		if (first == std::string::npos || line.compare(first, 8, "#include") != 0)
+		{
+			expanded << line << "\n";
+			continue;
+		}
+		const size_t open{ line.find('"', first) };
+		const size_t close{ open == std::string::npos ? open : line.find('"', open + 1) };
+		std::string included;
+		if (close == std::string::npos || include_depth >= max_include_depth)
+		{
+			std::cerr << "Invalid #include in shader " << path << " line " << line_number << std::endl;
+			return false;
+		}
+		if (!read_shader_file(directory + line.substr(open + 1, close - open - 1), included, include_depth + 1))
+			return false;
+		expanded << included << "#line " << line_number + 1 << "\n";
 	}
-	catch (const std::ifstream::failure& e)
+	code = expanded.str();
+	return true;
+}
+
+// Macros defined by the shader features, in bit order
+static const char* const feature_macros[]{ "FOG", "EXTRA_WAVES", "LOD_COLORS", "LAKE_BOTTOM", "ROCK", "GRASS", "SNOW" };
+static_assert(sizeof(feature_macros) / sizeof(feature_macros[0]) == shader_feature_count, "Every shader feature needs a macro");
+
+// Shader stages in pipeline order, as stored in Shader::stage_code
+struct Stage
+{
+	GLenum type;
+	const char* name; // Type reported by check_compile_errors
+};
+static constexpr Stage stages[]{
+	{ GL_VERTEX_SHADER, "VERTEX" },
+	{ GL_TESS_CONTROL_SHADER, "TESS_CONTROL" },
+	{ GL_TESS_EVALUATION_SHADER, "TESS_EVALUATION" },
+	{ GL_FRAGMENT_SHADER, "FRAGMENT" }
+};
+static constexpr size_t stage_count{ sizeof(stages) / sizeof(stages[0]) };
+
+/* Source code with a #define for each of features after the #version line, which has to come first, and a #line
+	directive so compile errors still report the line numbers of the file */
+static std::string code_with_features(const std::string& code, const uint32_t features)
+{
+	if (features == 0)
+		return code;
+	std::string defines;
+	for (uint32_t feature = 0; feature < shader_feature_count; feature++)
 	{
-		std::cerr << "Failed to open shader " << fragment_path << ": " << e.what() << std::endl;
-		return;
-	}
-
-	// Compile shaders
-	// Vertex shader
-	unsigned int vertex = glCreateShader(GL_VERTEX_SHADER);
-	const char* v_shader_code = vertex_code.c_str();
-	glShaderSource(vertex, 1, &v_shader_code, NULL);
-	glCompileShader(vertex);
-	check_compile_errors(vertex, "VERTEX");
-	// Fragment shader
-	unsigned int fragment = glCreateShader(GL_FRAGMENT_SHADER);
-	const char* f_shader_code = fragment_code.c_str();
-	glShaderSource(fragment, 1, &f_shader_code, NULL);
-	glCompileShader(fragment);
-	check_compile_errors(fragment, "FRAGMENT");
-	// Shader program
-	id = glCreateProgram();
-	glAttachShader(id, vertex);
-	glAttachShader(id, fragment);
-	glLinkProgram(id);
-	check_compile_errors(id, "PROGRAM");
-	// Delete the shaders as they're linked into our program now and no longer necessary
-	glDeleteShader(vertex);
-	glDeleteShader(fragment);
-}
-
-// Activate shader
-void Shader::use() const
+		if (features & (1u << feature))
+			defines += std::string{ "#define " } + feature_macros[feature] + "\n";
+	}
+	const size_t version_end{ code.compare(0, 8, "#version") == 0 ? code.find('\n') : std::string::npos };
+	if (version_end == std::string::npos)
+		return defines + "#line 1\n" + code;
+	return code.substr(0, version_end + 1) + defines + "#line 2\n" + code.substr(version_end + 1);
+}
+
+// Shader utility class, based on code by Joey de Vries: https://learnopengl.com/Getting-started/Shaders
+Shader::Shader(const char* vertex_path, const char* fragment_path, const uint32_t variant_features) :
+	Shader(vertex_path, nullptr, nullptr, fragment_path, variant_features)
 {
+}
+
+// Program with optional tessellation control and evaluation shaders, which are skipped if their path is null
+Shader::Shader(const char* vertex_path, const char* tess_control_path, const char* tess_evaluation_path, const char* fragment_path,
+	const uint32_t variant_features) :
+	variant_features(variant_features)
+{
+	glGenVertexArrays(1, &this->vao);
+	glBindVertexArray(this->vao);
+	use_program_cache = read_value_from_ini("shader_cache", true) && program_cache_supported();
+
+	// Retrieve the source code of every stage from its file, variants are compiled from it when they are first used
+	const char* const paths[stage_count]{ vertex_path, tess_control_path, tess_evaluation_path, fragment_path };
+	for (size_t i = 0; i < stage_count; i++)
+	{
+		if (paths[i] && !read_shader_file(paths[i], stage_code[i]))
+			return;
+	}
+	loaded = true;
+}
+
+/* Make the variant with features the current one and activate it, features outside the shader's variant features
+	are ignored. Compiles the variant if it is used for the first time. */
+void Shader::use(const uint32_t features)
+{
+	const uint32_t variant{ features & variant_features };
+	if (variants.empty() || variants[current].features != variant)
+	{
+		const auto found = std::find_if(variants.begin(), variants.end(), [variant](const Variant& v) { return v.features == variant; });
+		current = static_cast<size_t>(found - variants.begin());
+		if (found == variants.end())
+			variants.push_back(compile_variant(variant));
+		id = variants[current].id;
+	}
 	glUseProgram(id);
 }
 
 // Utility uniform functions
-void Shader::set_bool(const std::string& name, bool value) const
+void Shader::set_bool(const Uniform_name name, bool value)
+{
+	store(name, [value](const GLint location) { glUniform1i(location, static_cast<int>(value)); });
+}
+
+void Shader::set_int(const Uniform_name name, int value)
 {
-	glUniform1i(glGetUniformLocation(id, name.c_str()), static_cast<int>(value));
+	store(name, [value](const GLint location) { glUniform1i(location, value); });
 }
 
-void Shader::set_int(const std::string& name, int value) const
+void Shader::set_float(const Uniform_name name, float value)
 {
-	glUniform1i(glGetUniformLocation(id, name.c_str()), value);
+	store(name, [value](const GLint location) { glUniform1f(location, value); });
 }
 
-void Shader::set_float(const std::string& name, float value) const
+void Shader::set_vec2(const Uniform_name name, float x, float y)
 {
-	glUniform1f(glGetUniformLocation(id, name.c_str()), value);
+	store(name, [x, y](const GLint location) { glUniform2f(location, x, y); });
 }
 
-void Shader::set_vec3(const std::string& name, const glm::vec3& value) const
+void Shader::set_vec3(const Uniform_name name, const glm::vec3& value)
 {
-	glUniform3fv(glGetUniformLocation(id, name.c_str()), 1, &value[0]);
+	store(name, [value](const GLint location) { glUniform3fv(location, 1, &value[0]); });
 }
 
-void Shader::set_vec3(const std::string& name, float x, float y, float z) const
+void Shader::set_vec3(const Uniform_name name, float x, float y, float z)
 {
-	glUniform3f(glGetUniformLocation(id, name.c_str()), x, y, z);
+	store(name, [x, y, z](const GLint location) { glUniform3f(location, x, y, z); });
 }
 
 // Upload a glm::mat4 to shader program
-void Shader::set_mat4_f(const std::string& name, const glm::mat4 matrix) const
+void Shader::set_mat4_f(const Uniform_name name, const glm::mat4 matrix)
+{
+	store(name, [matrix](const GLint location) { glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(matrix)); });
+}
+
+// Compile and link the variant with features or load it from the program binary cache, then set the stored uniforms
+// in it. Leaves the variant in use.
+Shader::Variant Shader::compile_variant(const uint32_t features) const
+{
+	Variant variant{ features, 0, {}, {} };
+	if (!loaded)
+	{
+		variant.handle_locations.assign(handles.size(), -1);
+		return variant;
+	}
+
+	// Load the program from the binary cache, or compile shaders and link them into the program
+	std::string code[stage_count];
+	for (size_t i = 0; i < stage_count; i++)
+	{
+		if (!stage_code[i].empty())
+			code[i] = code_with_features(stage_code[i], features);
+	}
+	const uint64_t cache_key{ use_program_cache ? program_cache_key(code, stage_count) : 0 };
+	variant.id = glCreateProgram();
+	if (!use_program_cache || !load_program_cache(cache_key, variant.id))
+	{
+		unsigned int shaders[stage_count]{};
+		for (size_t i = 0; i < stage_count; i++)
+		{
+			if (code[i].empty())
+				continue;
+			shaders[i] = glCreateShader(stages[i].type);
+			const char* shader_code = code[i].c_str();
+			glShaderSource(shaders[i], 1, &shader_code, NULL);
+			glCompileShader(shaders[i]);
+			check_compile_errors(shaders[i], stages[i].name);
+			glAttachShader(variant.id, shaders[i]);
+		}
+		if (use_program_cache)
+			glProgramParameteri(variant.id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+		glLinkProgram(variant.id);
+		check_compile_errors(variant.id, "PROGRAM");
+		GLint linked{};
+		glGetProgramiv(variant.id, GL_LINK_STATUS, &linked);
+		if (use_program_cache && linked)
+			save_program_cache(cache_key, variant.id);
+		// Delete the shaders as they're linked into our program now and no longer necessary
+		for (const unsigned int shader : shaders)
+		{
+			if (shader)
+				glDeleteShader(shader);
+		}
+	}
+	// Programs using the per-frame uniform block read it from the shared buffer
+	const GLuint frame_block{ glGetUniformBlockIndex(variant.id, "Frame") };
+	if (frame_block != GL_INVALID_INDEX)
+		glUniformBlockBinding(variant.id, frame_block, frame_uniforms_binding);
+
+	// Resolve existing handles, then bring the variant up to date with the uniforms set so far
+	find_active_uniforms(variant);
+	variant.handle_locations.push_back(-1);
+	for (size_t slot = 1; slot < handles.size(); slot++)
+		variant.handle_locations.push_back(handle_location(variant, handles[slot], nullptr, false));
+	glUseProgram(variant.id);
+	for (const Stored_uniform& stored : stored_uniforms)
+	{
+		const Active_uniform* const uniform{ find_uniform(variant, stored.hash) };
+		if (uniform)
+			stored.set(uniform->location);
+	}
+	return variant;
+}
+
+// Fill the uniforms of variant from the active uniforms of its linked program
+void Shader::find_active_uniforms(Variant& variant)
 {
-	glUniformMatrix4fv(glGetUniformLocation(id, name.c_str()), 1, GL_FALSE, glm::value_ptr(matrix));
+	GLint count{};
+	GLint max_length{};
+	glGetProgramiv(variant.id, GL_ACTIVE_UNIFORMS, &count);
+	glGetProgramiv(variant.id, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_length);
+	std::vector<char> name(static_cast<size_t>(std::max(max_length, 1)));
+	for (GLint i = 0; i < count; i++)
+	{
+		GLsizei length{};
+		GLint size{};
+		GLenum type{};
+		glGetActiveUniform(variant.id, static_cast<GLuint>(i), max_length, &length, &size, &type, name.data());
+		// Arrays are reported as name[0], they are set through their plain name
+		if (length > 3 && std::strcmp(name.data() + length - 3, "[0]") == 0)
+			name[static_cast<size_t>(length) - 3] = '\0';
+		const GLint location{ glGetUniformLocation(variant.id, name.data()) };
+		if (location < 0)
+			continue; // Member of a uniform block
+		variant.uniforms.push_back(Active_uniform{ uniform_hash(name.data()), location, type });
+	}
+
+	std::vector<Active_uniform>& uniforms{ variant.uniforms };
+	std::sort(uniforms.begin(), uniforms.end(), [](const Active_uniform& a, const Active_uniform& b) { return a.hash < b.hash; });
+	const auto collision = std::adjacent_find(uniforms.begin(), uniforms.end(),
+		[](const Active_uniform& a, const Active_uniform& b) { return a.hash == b.hash; });
+	if (collision != uniforms.end())
+		std::cerr << "Shader: two uniforms of program " << variant.id << " have the same name hash, one of them can not be set\n";
 }
 
-// Load a texture, using int reference to texture only
-void Shader::load_stb_texture_ref(const char* filename, GLuint* texture_ref, bool alpha)
+// Active uniform with hash in variant, nullptr if there is none
+const Shader::Active_uniform* Shader::find_uniform(const Variant& variant, const uint32_t hash)
+{
+	const auto uniform = std::lower_bound(variant.uniforms.begin(), variant.uniforms.end(), hash,
+		[](const Active_uniform& a, const uint32_t h) { return a.hash < h; });
+	return uniform != variant.uniforms.end() && uniform->hash == hash ? &*uniform : nullptr;
+}
+
+/* Location of the uniform of handle in variant, reporting type mismatches and, if required, missing uniforms.
+	Reported handles abort debug builds and get location -1 otherwise. name is only used in messages. */
+GLint Shader::handle_location(const Variant& variant, const Handle& handle, const char* name, const bool required)
+{
+	const Active_uniform* const uniform{ find_uniform(variant, handle.hash) };
+	if (!uniform)
+	{
+		if (!required)
+			return -1;
+		std::cerr << "Shader: program " << variant.id << " has no active uniform " << name << "\n";
+	}
+	else
+	{
+		// Samplers are set like int uniforms
+		const bool sampler{ uniform->type == GL_SAMPLER_2D || uniform->type == GL_SAMPLER_2D_ARRAY || uniform->type == GL_SAMPLER_CUBE };
+		if (uniform->type == handle.type || (handle.type == GL_INT && sampler))
+			return uniform->location;
+		std::cerr << "Shader: uniform " << (name ? name : "of a handle") << " of program " << variant.id
+			<< " has another type than its handle\n";
+	}
+#ifdef _DEBUG
+	std::abort();
+#endif
+	return -1;
+}
+
+// Register a handle for the uniform name of GL type and return its slot, required reports a missing uniform
+uint32_t Shader::add_handle(const Uniform_name name, const GLenum type, const bool required)
+{
+	const Handle handle{ name.hash, type };
+	if (variants.empty())
+	{
+		std::cerr << "Shader: handle for uniform " << name.name << " requested before the shader was used\n";
+#ifdef _DEBUG
+		std::abort();
+#endif
+		return 0;
+	}
+	const auto existing = std::find_if(handles.begin() + 1, handles.end(),
+		[&handle](const Handle& h) { return h.hash == handle.hash && h.type == handle.type; });
+	const uint32_t slot{ static_cast<uint32_t>(existing - handles.begin()) };
+	if (existing != handles.end())
+	{
+		handle_location(variants[current], handle, name.name, required);
+		return slot;
+	}
+
+	handles.push_back(handle);
+	for (size_t i = 0; i < variants.size(); i++)
+		variants[i].handle_locations.push_back(handle_location(variants[i], handle, name.name, required && i == current));
+	return slot;
+}
+
+// Set a uniform by name in every variant and keep it for variants compiled later
+void Shader::store(const Uniform_name name, std::function<void(GLint)> set)
+{
+	for (const Variant& variant : variants)
+	{
+		const Active_uniform* const uniform{ find_uniform(variant, name.hash) };
+		if (!uniform)
+			continue;
+		glUseProgram(variant.id);
+		set(uniform->location);
+	}
+	if (!variants.empty())
+		glUseProgram(id);
+
+	const auto existing = std::find_if(stored_uniforms.begin(), stored_uniforms.end(),
+		[&name](const Stored_uniform& stored) { return stored.hash == name.hash; });
+	if (existing != stored_uniforms.end())
+		existing->set = std::move(set);
+	else
+		stored_uniforms.push_back(Stored_uniform{ name.hash, std::move(set) });
+}
+
+// Upload an already decoded image into a new texture, using int reference to texture only
+void Shader::load_texture(const Decoded_image& image, GLuint* texture_ref, bool alpha)
 {
-	int width_temp, height_temp;
 	glGenTextures(1, texture_ref);
 	glBindTexture(GL_TEXTURE_2D, *texture_ref);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_LINEAR);
@@ -129,24 +381,16 @@ void Shader::load_stb_texture_ref(const char* filename, GLuint* texture_ref, boo
 	// GL_MIRRORED_REPEAT could potentially be used for one coordinate to slightly reduce repeating pattern
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	// Load image, create texture and generate mipmaps
-	int nr_channels;
-	// stbi_set_flip_vertically_on_load(true); // Tell stb_image.h to flip loaded texture y-axis
-	unsigned char* data = stbi_load(filename, &width_temp, &height_temp, &nr_channels, 0);
-	if (data)
+	// Create texture and generate mipmaps
+	if (image.data)
 	{
 		if (alpha) // Does the texture have an alpha channel?
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width_temp, height_temp, 0, GL_RGBA, GL_UNSIGNED_BYTE, data); // Unsure if GL_RGB or GL_RGBA in third argument
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, image.width, image.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image.data.get()); // Unsure if GL_RGB or GL_RGBA in third argument
 		else
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width_temp, height_temp, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, image.width, image.height, 0, GL_RGB, GL_UNSIGNED_BYTE, image.data.get());
 
 		glGenerateMipmap(GL_TEXTURE_2D);
 	}
-	else
-	{
-		std::cerr << "Failed to load texture " << filename << std::endl;
-	}
-	stbi_image_free(data);
 }
 
 // Utility function for checking shader compilation/linking errors.
@@ -1,39 +1,214 @@
 ﻿#pragma once
+#include "util_misc.h"
 #include <glad/glad.h>
+#include <glm/gtc/type_ptr.hpp>
 #include <glm/mat4x4.hpp>
+#include <glm/vec2.hpp>
 #include <glm/vec3.hpp>
+#include <cstdint>
+#include <functional>
 #include <string>
+#include <vector>
 
-// Shader utility class, based on code by Joey de Vries: https://learnopengl.com
+// 32-bit FNV-1a hash of a uniform name, constexpr so names given as string literals can be hashed at compile time
+constexpr uint32_t uniform_hash(const char* name)
+{
+	uint32_t hash{ 0x811C9DC5u };
+	for (; *name != '\0'; name++)
+	{
+		hash ^= static_cast<unsigned char>(*name);
+		hash *= 0x01000193u;
+	}
+	return hash;
+}
+
+// Uniform name and its hash, implicitly constructed from a string literal so the hash can be folded at compile time
+struct Uniform_name
+{
+	constexpr Uniform_name(const char* name) : name(name), hash(uniform_hash(name)) {}
+
+	const char* name;
+	uint32_t hash;
+};
+
+/* Handle of a uniform of GLSL type T in one Shader, from Shader::uniform. It refers to the uniform in every variant
+	of the shader, setting it is a single glUniform* call. int is used for int and sampler uniforms. */
+template <typename T>
+struct Uniform
+{
+	uint32_t slot{ 0 }; // Index of the uniform's location in each variant, slot 0 sets nothing
+};
+
+// GL type of the uniforms a Uniform<T> handle can refer to
+template <typename T>
+constexpr GLenum uniform_gl_type{ 0 };
+template <>
+constexpr GLenum uniform_gl_type<bool>{ GL_BOOL };
+template <>
+constexpr GLenum uniform_gl_type<int>{ GL_INT };
+template <>
+constexpr GLenum uniform_gl_type<float>{ GL_FLOAT };
+template <>
+constexpr GLenum uniform_gl_type<glm::vec2>{ GL_FLOAT_VEC2 };
+template <>
+constexpr GLenum uniform_gl_type<glm::vec3>{ GL_FLOAT_VEC3 };
+template <>
+constexpr GLenum uniform_gl_type<glm::mat4>{ GL_FLOAT_MAT4 };
+
+/* Features a Shader variant can be compiled with, each one #defines its macro in every stage of the variant.
+	They replace uniform bools, so code for disabled features is compiled out instead of branched over. */
+constexpr uint32_t shader_fog{ 1u << 0 }; // FOG: fog colour instead of lighting (F1)
+constexpr uint32_t shader_extra_waves{ 1u << 1 }; // EXTRA_WAVES: more waves on the water surface (F2)
+constexpr uint32_t shader_lod_colors{ 1u << 2 }; // LOD_COLORS: terrain tinted by level of detail (F4)
+constexpr uint32_t shader_lake_bottom{ 1u << 3 }; // LAKE_BOTTOM: terrain material below and at the sea
+constexpr uint32_t shader_rock{ 1u << 4 }; // ROCK: terrain material above the sea, under grass and snow
+constexpr uint32_t shader_grass{ 1u << 5 }; // GRASS: terrain material on flat ground below the snow line
+constexpr uint32_t shader_snow{ 1u << 6 }; // SNOW: terrain material above the snow line
+constexpr uint32_t shader_terrain_materials{ shader_lake_bottom | shader_rock | shader_grass | shader_snow };
+constexpr uint32_t shader_feature_count{ 7 };
+
+/* Shader utility class, based on code by Joey de Vries: https://learnopengl.com
+	A Shader is a set of program variants compiled from the same source files with different features, each variant is
+	compiled the first time it is used. Linked variants are kept in the program binary cache (program_cache.h) and
+	loaded from it on later runs. Uniforms set by name apply to every variant, including those compiled later,
+	so setup can be done once before the shader is used. */
 class Shader
 {
 public:
-	unsigned int id;
+	unsigned int id{ 0 }; // Program of the current variant, 0 until the shader is used
 	// TODO: vao is not used by terrain_shader
 	// TODO: Why do Shaders have vaos?
 	unsigned int vao; // Vertex array object ID
-	Shader(const char* vertex_path, const char* fragment_path);
 
-	// Activate shader
-	void use() const;
+	// Program from vertex and fragment shader files whose variants use the features in variant_features
+	Shader(const char* vertex_path, const char* fragment_path, const uint32_t variant_features = 0);
+
+	// Program with optional tessellation control and evaluation shaders, which are skipped if their path is null
+	Shader(const char* vertex_path, const char* tess_control_path, const char* tess_evaluation_path, const char* fragment_path,
+		const uint32_t variant_features = 0);
+
+	Shader(const Shader&) = delete;
+	Shader& operator=(const Shader&) = delete;
+
+	/* Make the variant with features the current one and activate it, features outside the shader's variant features
+		are ignored. Compiles the variant if it is used for the first time. */
+	void use(const uint32_t features = 0);
+
+	/* Handle of the active uniform name of type T. A name that is not active in the current variant or has another
+		type is reported and aborts debug builds, release builds get a handle that sets nothing. Variants compiled
+		later, which may have compiled the uniform out, are not checked for the name but for the type. */
+	template <typename T>
+	Uniform<T> uniform(const Uniform_name name)
+	{
+		static_assert(uniform_gl_type<T> != 0, "Uniform handles support bool, int, float, vec2, vec3 and mat4");
+		return Uniform<T>{ add_handle(name, uniform_gl_type<T>, true) };
+	}
 
-	// Utility uniform functions
-	void set_bool(const std::string& name, bool value) const;
+	/* Handle of the uniform name of type T that a feature may compile out, like uniform, but a name that is not
+		active in the current variant is not reported. */
+	template <typename T>
+	Uniform<T> optional_uniform(const Uniform_name name)
+	{
+		static_assert(uniform_gl_type<T> != 0, "Uniform handles support bool, int, float, vec2, vec3 and mat4");
+		return Uniform<T>{ add_handle(name, uniform_gl_type<T>, false) };
+	}
 
-	void set_int(const std::string& name, int value) const;
+	// Set uniforms of the current variant through handles, the shader must be in use
+	void set(const Uniform<bool> uniform, const bool value) const { glUniform1i(location(uniform.slot), static_cast<int>(value)); }
+	void set(const Uniform<int> uniform, const int value) const { glUniform1i(location(uniform.slot), value); }
+	void set(const Uniform<float> uniform, const float value) const { glUniform1f(location(uniform.slot), value); }
+	void set(const Uniform<glm::vec2> uniform, const glm::vec2& value) const { glUniform2f(location(uniform.slot), value.x, value.y); }
+	void set(const Uniform<glm::vec3> uniform, const glm::vec3& value) const
+	{
+		glUniform3f(location(uniform.slot), value.x, value.y, value.z);
+	}
+	void set(const Uniform<glm::mat4> uniform, const glm::mat4& value) const
+	{
+		glUniformMatrix4fv(location(uniform.slot), 1, GL_FALSE, glm::value_ptr(value));
+	}
 
-	void set_float(const std::string& name, float value) const;
+	/* Utility uniform functions, for setup. The value is set in every variant, which leaves the current variant in use.
+		Names that are not active in a variant are ignored. */
+	void set_bool(const Uniform_name name, bool value);
 
-	void set_vec3(const std::string& name, const glm::vec3& value) const;
+	void set_int(const Uniform_name name, int value);
 
-	void set_vec3(const std::string& name, float x, float y, float z) const;
+	void set_float(const Uniform_name name, float value);
 
-	void set_mat4_f(const std::string& name, const glm::mat4 matrix) const;
+	void set_vec2(const Uniform_name name, float x, float y);
 
-	// Load a texture, using int reference to texture only
-	static void load_stb_texture_ref(const char* filename, GLuint* texture_ref, bool alpha);
+	void set_vec3(const Uniform_name name, const glm::vec3& value);
+
+	void set_vec3(const Uniform_name name, float x, float y, float z);
+
+	void set_mat4_f(const Uniform_name name, const glm::mat4 matrix);
+
+	// Upload an already decoded image into a new texture, using int reference to texture only
+	static void load_texture(const Decoded_image& image, GLuint* texture_ref, bool alpha);
 
 private:
 	// Utility function for checking shader compilation/linking errors
 	static void check_compile_errors(unsigned int shader, const std::string& type);
+
+	// Location, hash and GL type of one active uniform outside uniform blocks
+	struct Active_uniform
+	{
+		uint32_t hash;
+		GLint location;
+		GLenum type;
+	};
+
+	// Program compiled with one set of features
+	struct Variant
+	{
+		uint32_t features;
+		GLuint id;
+		std::vector<Active_uniform> uniforms; // Sorted by hash
+		std::vector<GLint> handle_locations; // Location of each handle's uniform, -1 if it is not active
+	};
+
+	// Name hash and GL type (as in uniform_gl_type) of the uniform of a handle
+	struct Handle
+	{
+		uint32_t hash;
+		GLenum type;
+	};
+
+	// Uniform set by name, replayed into variants compiled later
+	struct Stored_uniform
+	{
+		uint32_t hash;
+		std::function<void(GLint)> set; // Sets the value at a location of the program in use
+	};
+
+	// Compile and link the variant with features or load it from the program binary cache, then set the stored uniforms
+	// in it. Leaves the variant in use.
+	Variant compile_variant(const uint32_t features) const;
+
+	// Fill the uniforms of variant from the active uniforms of its linked program
+	static void find_active_uniforms(Variant& variant);
+
+	// Active uniform with hash in variant, nullptr if there is none
+	static const Active_uniform* find_uniform(const Variant& variant, const uint32_t hash);
+
+	// Location of the uniform of handle in variant, reporting type mismatches and, if required, missing uniforms
+	static GLint handle_location(const Variant& variant, const Handle& handle, const char* name, const bool required);
+
+	// Register a handle for the uniform name of GL type and return its slot, required reports a missing uniform
+	uint32_t add_handle(const Uniform_name name, const GLenum type, const bool required);
+
+	// Set a uniform by name in every variant and keep it for variants compiled later
+	void store(const Uniform_name name, std::function<void(GLint)> set);
+
+	// Location of the uniform of handle slot in the current variant
+	GLint location(const uint32_t slot) const { return variants.empty() ? -1 : variants[current].handle_locations[slot]; }
+
+	std::string stage_code[4]; // Source of the vertex, tessellation control, tessellation evaluation and fragment shader
+	bool loaded{ false }; // True if every stage file was read
+	bool use_program_cache{ false }; // Load and save linked variants with the program binary cache
+	uint32_t variant_features{ 0 };
+	std::vector<Variant> variants{}; // In order of first use
+	size_t current{ 0 }; // Index of the current variant
+	std::vector<Handle> handles{ Handle{ 0, 0 } }; // Slot 0 is no uniform
+	std::vector<Stored_uniform> stored_uniforms{};
 };
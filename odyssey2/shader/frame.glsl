@@ -0,0 +1,12 @@
+// Per-frame data shared by all programs, updated once per frame from Frame_uniforms in frame_uniforms.h.
+// std140 layout, the members must stay in the same order as there.
+layout(std140) uniform Frame
+{
+	mat4 worldToView;
+	mat4 projection;
+	mat4 skyWorldToView; // worldToView without the translation
+	mat4 normalMatrix; // Transforms world normals to view coordinates, in the upper 3x3
+	vec3 cameraPos;
+	float time; // Seconds since start
+	vec3 fogColor; // Fog is drawn by the FOG variants of the shaders
+};
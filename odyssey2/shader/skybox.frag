@@ -1,16 +1,18 @@
 #version 400 core
+// Features: FOG
 in vec3 TexCoord;
 
 out vec4 outColor;
 
+#include "frame.glsl"
+
 uniform samplerCube skyboxTex;
-uniform bool drawFog;
-uniform vec3 fogColor;
 
 void main()
 {
-	if (!drawFog)
-		outColor = texture(skyboxTex, TexCoord);
-	else
-		outColor = vec4(fogColor, 1.0f);
+#ifndef FOG
+	outColor = texture(skyboxTex, TexCoord);
+#else
+	outColor = vec4(fogColor, 1.0f);
+#endif
 }
\ No newline at end of file
@@ -3,11 +3,10 @@ in vec3 inPos;
 
 out vec3 TexCoord;
 
-uniform mat4 projection;
-uniform mat4 worldToView;
+#include "frame.glsl"
 
 void main()
 {
     TexCoord = inPos;
-    gl_Position = projection * worldToView * vec4(inPos, 1.0);
+    gl_Position = projection * skyWorldToView * vec4(inPos, 1.0);
 } 
\ No newline at end of file
@@ -1,9 +1,21 @@
 #version 400 core
+// Features: FOG, LOD_COLORS and the materials LAKE_BOTTOM, ROCK, GRASS and SNOW. Variants for parts of the terrain
+// only define the materials found at their heights, a variant without materials draws all of them.
+#if !defined(LAKE_BOTTOM) && !defined(ROCK) && !defined(GRASS) && !defined(SNOW)
+#define LAKE_BOTTOM
+#define ROCK
+#define GRASS
+#define SNOW
+#endif
+#if (defined(GRASS) || defined(SNOW)) && !defined(ROCK)
+#define ROCK // Grass and snow are blended over rock
+#endif
 #define multiTexYLim 0.75
 in vec2 passTexCoord;
 in vec3 passNormal;
 in vec3 phongNormal;
 in vec3 pixelPos; // Fragment position in world coordinates
+in vec3 passLodColor; // Level of detail debug colour
 
 out vec4 outColor;
 
@@ -15,9 +27,8 @@ uniform sampler2D snowTex;
 uniform sampler2D grassTex;
 uniform sampler2D rockTex;
 uniform sampler2D bottomTex;
-uniform mat4 worldToView; // Transform light source to view coords
-uniform bool drawFog;
-uniform vec3 fogColor;
+
+#include "frame.glsl" // worldToView transforms the light source to view coords
 
 void main(void)
 {
@@ -33,35 +44,54 @@ void main(void)
 	
 	// --------------- Multitexturing -----------------
 	// Lake bottom/shoreline
+#if defined(LAKE_BOTTOM) && defined(ROCK)
 	if (pixelPos.y < seaHeight + 1.0) {
+#endif
+#ifdef LAKE_BOTTOM
 		// Approximate light loss through deep water by gradually darkening fragments
 		float depthFac = max(1 + (pixelPos.y - seaHeight) / pow(pixelPos.y - minHeight, 0.8), 0.15f);
 		outColor = vec4(shade * depthFac * vec3(texture(bottomTex, passTexCoord)), 1.0);
+#endif
+#if defined(LAKE_BOTTOM) && defined(ROCK)
 	}
 	else {
+#endif
+#ifdef ROCK
 		// Rocky slope (underlying ground)
 		outColor = vec4(shade * vec3(texture(rockTex, passTexCoord)), 1.0);
+#endif
 
 		// Blend ground with snow/grass
+#ifdef GRASS
 		if (pixelPos.y < snowHeight && normalize(passNormal).y > multiTexYLim) {
 			// Gradually blend between rock/grass depending on angle of the surface and proximity to snow height
 			float grassBlend = clamp(8.0f * (normalize(passNormal).y - multiTexYLim) + 1.0f / (pixelPos.y - snowHeight), 0.0f, 1.0f);
 			outColor = mix(outColor, vec4(shade * vec3(texture(grassTex, passTexCoord)), 1.0), grassBlend);
 		}
-		else if (pixelPos.y > snowHeight) {
+#endif
+#ifdef SNOW
+		if (pixelPos.y > snowHeight) {
 			// Gradually blend between rock/snow depending on angle of the surface and altitude
 			float snowBlend = min((pixelPos.y - snowHeight) * normalize(passNormal).y / pow(maxHeight - pixelPos.y, 0.85), 1.0f);
 			outColor = mix(outColor, vec4(shade * vec3(texture(snowTex, passTexCoord)), 1.0), snowBlend);
 		}
+#endif
+#if defined(LAKE_BOTTOM) && defined(ROCK)
 	}
-	
+#endif
+
+#ifdef LOD_COLORS
+	// Tint the terrain by level of detail
+	outColor = vec4(vec3(outColor) * passLodColor, 1.0);
+#endif
+
 	// -------------------- Fog -----------------------
-	if (drawFog) {
-		float zNear = 3.0f;
-		float zFar = 128.0f; // Fog distance
-		float z = gl_FragCoord.z * 2.0 - 1.0; // Normalized device coordinates
-		float depth = (2.0 * zNear * zFar) / (zFar + zNear - z * (zFar - zNear));
-		depth = sqrt(depth / zFar); // sqrt gives a bit denser fog
-		outColor = vec4(depth * fogColor + (1 - depth) * vec3(outColor), 1.0);
-	}
+#ifdef FOG
+	float zNear = 3.0f;
+	float zFar = 128.0f; // Fog distance
+	float z = gl_FragCoord.z * 2.0 - 1.0; // Normalized device coordinates
+	float depth = (2.0 * zNear * zFar) / (zFar + zNear - z * (zFar - zNear));
+	depth = sqrt(depth / zFar); // sqrt gives a bit denser fog
+	outColor = vec4(depth * fogColor + (1 - depth) * vec3(outColor), 1.0);
+#endif
 }
@@ -1,29 +1,32 @@
 #version 400 core
-in vec3 inPos;
-in vec2 inTexCoord;
-in vec3 inNormal;
+layout(location = 0) in vec3 inPos; // World position, or grid position and height for quantized vertices
+layout(location = 1) in vec3 inNormal;
 
 out vec2 passTexCoord;
 out vec3 passNormal;
 out vec3 phongNormal;
 out vec3 pixelPos; // Fragment position in world coordinates
+out vec3 passLodColor; // Level of detail debug colour, white here, only shown with LOD_COLORS
 
 //uniform mat4 modelToWorld; // Already in world coordinates
-uniform mat4 worldToView;
-uniform mat4 projection;
+#include "frame.glsl"
+
+uniform vec3 positionScale; // World position = inPos * positionScale + positionOffset
+uniform vec3 positionOffset;
+uniform float texScale; // Texture coordinates per world unit in x and z
 
 void main(void)
 {
-	mat3 normalMatrix1 = mat3(worldToView);
-
+	vec3 pos = inPos * positionScale + positionOffset;
 	// Phong, normal transformation
-	phongNormal = inverse(transpose(normalMatrix1)) * inNormal;
+	phongNormal = mat3(normalMatrix) * inNormal;
 
 	// Direction that the camera is looking
-	vec3 player = vec3(normalize(-vec3(worldToView * vec4(inPos, 1.0))));
+	vec3 player = vec3(normalize(-vec3(worldToView * vec4(pos, 1.0))));
 
-	passTexCoord = inTexCoord;
+	passTexCoord = pos.xz * texScale;
 	passNormal = inNormal;
-	pixelPos = inPos;
-	gl_Position = projection * worldToView * vec4(inPos, 1.0);
+	pixelPos = pos;
+	passLodColor = vec3(1.0);
+	gl_Position = projection * worldToView * vec4(pos, 1.0);
 }
@@ -0,0 +1,75 @@
+#version 400 core
+// CDLOD terrain without vertex buffers: each instance is one row of a node's grid drawn as a triangle strip.
+// Vertices morph towards the grid of the next coarser level near the end of their level's range, so nodes
+// of neighbouring levels meet without cracks.
+
+out vec2 passTexCoord;
+out vec3 passNormal;
+out vec3 phongNormal;
+out vec3 pixelPos; // Fragment position in world coordinates
+out vec3 passLodColor;
+
+#include "frame.glsl"
+
+uniform sampler2D heightTex; // One texel per grid point, R32F or R16
+uniform float heightScale; // Height = texel * heightScale + heightOffset
+uniform float heightOffset;
+uniform float xzScale; // Distance between neighbouring grid points
+uniform float texScale; // Texture coordinates per world unit in x and z
+uniform vec3 node; // Grid column and row of the node's first vertex and the grid step of its level
+uniform vec2 morphRange; // Distances from the camera where morphing to the next level starts and ends
+uniform int lodLevel;
+
+// Height of grid point p
+float height(ivec2 p)
+{
+	return texelFetch(heightTex, p, 0).r * heightScale + heightOffset;
+}
+
+// Normal at grid point p from central differences, wrapping around the edges like the heightmap
+vec3 normal(ivec2 p)
+{
+	ivec2 size = textureSize(heightTex, 0);
+	float dx = height((p + ivec2(1, 0)) % size) - height((p + size - ivec2(1, 0)) % size);
+	float dz = height((p + ivec2(0, 1)) % size) - height((p + size - ivec2(0, 1)) % size);
+	return vec3(-dx, 2.0 * xzScale, -dz);
+}
+
+void main(void)
+{
+	// Even vertices are on the row of the instance, odd ones on the row below it
+	int step = int(node.z);
+	ivec2 local = ivec2(gl_VertexID >> 1, gl_InstanceID + (gl_VertexID & 1));
+	ivec2 fine = ivec2(node.xy) + local * step;
+
+	// Odd vertices of this level collapse onto the even vertex before them, which leaves the coarser grid.
+	// Nodes may reach past the last grid point, those vertices are clamped to it and never move.
+	ivec2 last = textureSize(heightTex, 0) - 1;
+	ivec2 coarse = fine - ((fine / step) & 1) * step;
+	fine = min(fine, last);
+	coarse = min(coarse, last);
+	if (fine.x == last.x)
+		coarse.x = fine.x;
+	if (fine.y == last.y)
+		coarse.y = fine.y;
+
+	float fineHeight = height(fine);
+	vec3 finePos = vec3(fine.x * xzScale, fineHeight, fine.y * xzScale);
+	float morph = clamp((distance(finePos, cameraPos) - morphRange.x) / (morphRange.y - morphRange.x), 0.0, 1.0);
+	vec2 grid = mix(vec2(fine), vec2(coarse), morph);
+	vec3 pos = vec3(grid.x * xzScale, mix(fineHeight, height(coarse), morph), grid.y * xzScale);
+	vec3 norm = normalize(mix(normal(fine), normal(coarse), morph));
+
+	// Phong, normal transformation
+	phongNormal = mat3(normalMatrix) * norm;
+
+	// Debug colours of this and the next level, blended like the geometry
+	const vec3 lodColors[6] = vec3[](vec3(1.0, 0.3, 0.3), vec3(1.0, 1.0, 0.3), vec3(0.3, 1.0, 0.3),
+		vec3(0.3, 1.0, 1.0), vec3(0.3, 0.3, 1.0), vec3(1.0, 0.3, 1.0));
+	passLodColor = mix(lodColors[lodLevel % 6], lodColors[(lodLevel + 1) % 6], morph);
+
+	passTexCoord = pos.xz * texScale;
+	passNormal = norm;
+	pixelPos = pos;
+	gl_Position = projection * worldToView * vec4(pos, 1.0);
+}
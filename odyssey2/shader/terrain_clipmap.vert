@@ -0,0 +1,73 @@
+#version 400 core
+// Geometry clipmap terrain without vertex buffers: each instance is one row of a rectangle of a clipmap level drawn
+// as a triangle strip. Heights come from the level's layer of the clipmap texture, which is addressed toroidally.
+// Near the outer edge of their level vertices blend to the grid of the next coarser level, so rings meet without cracks.
+
+out vec2 passTexCoord;
+out vec3 passNormal;
+out vec3 phongNormal;
+out vec3 pixelPos; // Fragment position in world coordinates
+out vec3 passLodColor;
+
+#include "frame.glsl"
+
+uniform sampler2DArray heightTex; // One layer per level, one texel per grid point of the level, R32F or R16
+uniform float heightScale; // Height = texel * heightScale + heightOffset
+uniform float heightOffset;
+uniform float xzScale; // Distance between neighbouring grid points
+uniform float texScale; // Texture coordinates per world unit in x and z
+uniform vec2 rectOrigin; // Level grid position of the first vertex of the rectangle
+uniform vec2 levelOrigin; // Level grid position of the first vertex of the level
+uniform int lodLevel;
+uniform int coarsestLevel; // Vertices of the coarsest level do not blend
+uniform float gridCells; // Cells along each side of a level
+uniform float morphCells; // Cells at the outer edge of a level over which vertices blend
+
+// Height of level grid position p
+float height(ivec2 p)
+{
+	ivec2 size = textureSize(heightTex, 0).xy;
+	return texelFetch(heightTex, ivec3(p & (size - 1), lodLevel), 0).r * heightScale + heightOffset;
+}
+
+// Normal at level grid position p from central differences over distance grid positions
+vec3 normal(ivec2 p, int distance)
+{
+	float dx = height(p + ivec2(distance, 0)) - height(p - ivec2(distance, 0));
+	float dz = height(p + ivec2(0, distance)) - height(p - ivec2(0, distance));
+	return normalize(vec3(-dx, 2.0 * distance * (1 << lodLevel) * xzScale, -dz));
+}
+
+void main(void)
+{
+	// Even vertices are on the row of the instance, odd ones on the row below it
+	ivec2 p = ivec2(rectOrigin) + ivec2(gl_VertexID >> 1, gl_InstanceID + (gl_VertexID & 1));
+
+	// Blend factor rises from 0 to 1 over the outer morphCells cells of the level
+	vec2 local = vec2(p - ivec2(levelOrigin));
+	vec2 edge = min(local, gridCells - local);
+	float morph = lodLevel == coarsestLevel ? 0.0 : clamp(1.0 - min(edge.x, edge.y) / morphCells, 0.0, 1.0);
+
+	// On the coarser grid a vertex with odd coordinates lies on the edge or diagonal between two coarser vertices,
+	// (x, z+1) to (x+1, z) like the triangle split of the mesh
+	ivec2 odd = p & 1;
+	float fineHeight = height(p);
+	float coarseHeight = 0.5 * (height(p + ivec2(-odd.x, odd.y)) + height(p + ivec2(odd.x, -odd.y)));
+
+	int step = 1 << lodLevel;
+	vec3 pos = vec3(float(p.x * step) * xzScale, mix(fineHeight, coarseHeight, morph), float(p.y * step) * xzScale);
+	vec3 norm = normalize(mix(normal(p, 1), normal(p, 2), morph));
+
+	// Phong, normal transformation
+	phongNormal = mat3(normalMatrix) * norm;
+
+	// Debug colours of this and the next level, blended like the geometry
+	const vec3 lodColors[6] = vec3[](vec3(1.0, 0.3, 0.3), vec3(1.0, 1.0, 0.3), vec3(0.3, 1.0, 0.3),
+		vec3(0.3, 1.0, 1.0), vec3(0.3, 0.3, 1.0), vec3(1.0, 0.3, 1.0));
+	passLodColor = mix(lodColors[lodLevel % 6], lodColors[(lodLevel + 1) % 6], morph);
+
+	passTexCoord = pos.xz * texScale;
+	passNormal = norm;
+	pixelPos = pos;
+	gl_Position = projection * worldToView * vec4(pos, 1.0);
+}
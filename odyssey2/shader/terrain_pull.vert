@@ -0,0 +1,46 @@
+#version 400 core
+// Terrain without vertex buffers: each instance is one row of grid cells drawn as a triangle strip of
+// 2 * width vertices, position and normal are rebuilt from the grid index and the heightmap texture.
+
+out vec2 passTexCoord;
+out vec3 passNormal;
+out vec3 phongNormal;
+out vec3 pixelPos; // Fragment position in world coordinates
+out vec3 passLodColor; // Level of detail debug colour, white here, only shown with LOD_COLORS
+
+#include "frame.glsl"
+
+uniform sampler2D heightTex; // One texel per grid point, R32F or R16
+uniform float heightScale; // Height = texel * heightScale + heightOffset
+uniform float heightOffset;
+uniform float xzScale; // Distance between neighbouring grid points
+uniform float texScale; // Texture coordinates per world unit in x and z
+
+// Height of grid point p, wrapping around the edges like the heightmap
+float height(ivec2 p)
+{
+	ivec2 size = textureSize(heightTex, 0);
+	return texelFetch(heightTex, (p + size) % size, 0).r * heightScale + heightOffset;
+}
+
+void main(void)
+{
+	// Even vertices are on the row of the instance, odd ones on the row below it. The strip then
+	// splits every cell along the same diagonal as the indexed mesh.
+	ivec2 grid = ivec2(gl_VertexID >> 1, gl_InstanceID + (gl_VertexID & 1));
+	vec3 pos = vec3(grid.x * xzScale, height(grid), grid.y * xzScale);
+
+	// Central differences, same as compute_terrain_normals on the CPU
+	float dx = height(grid + ivec2(1, 0)) - height(grid - ivec2(1, 0));
+	float dz = height(grid + ivec2(0, 1)) - height(grid - ivec2(0, 1));
+	vec3 normal = normalize(vec3(-dx, 2.0 * xzScale, -dz));
+
+	// Phong, normal transformation
+	phongNormal = mat3(normalMatrix) * normal;
+
+	passTexCoord = pos.xz * texScale;
+	passNormal = normal;
+	pixelPos = pos;
+	passLodColor = vec3(1.0);
+	gl_Position = projection * worldToView * vec4(pos, 1.0);
+}
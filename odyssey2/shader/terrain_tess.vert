@@ -0,0 +1,11 @@
+#version 400 core
+// Tessellated terrain: passes the corners of the coarse patch grid on, the evaluation shader reads the heights
+
+layout(location = 0) in vec2 inGrid; // Grid column and row of the corner
+
+out vec2 controlGrid;
+
+void main(void)
+{
+	controlGrid = inGrid;
+}
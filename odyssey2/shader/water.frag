@@ -1,20 +1,19 @@
 #version 400 core
+// Features: FOG, EXTRA_WAVES
 #define M_PI 3.1415926535897932384626433832795
 in vec3 Position;
 
 out vec4 outColor;
 
+#include "frame.glsl"
+
 uniform samplerCube skybox;
-uniform vec3 cameraPos;
-uniform float time;
-uniform bool drawFog;
-uniform bool extraWaves;
-uniform vec3 fogColor;
 uniform float worldSize;
 
 void main()
 {
-	if (!drawFog) {
+#ifndef FOG
+	{
 		// ------------------ Calculate wave effect for normal --------------------
 		vec3 normal = vec3(0.0, 1.0, 0.0);
 		int numWaves = 128;
@@ -23,7 +22,7 @@ void main()
 		normal.x = pow(abs(sin(2 * M_PI * (-time / 10 + normPos * numWaves))), 2) / 64;
 
 		// Add several waves with different velocity and amplitude
-		if (extraWaves)
+#ifdef EXTRA_WAVES
 		{
 			normPos = Position.z / worldSize;
 			normal.z += pow(abs(sin(2 * M_PI * (time / 6 + normPos * numWaves * 2 + 0.2))), 2) / 64;
@@ -34,6 +33,7 @@ void main()
 			normPos = (Position.x + Position.z) / (2.0 * worldSize);
 			normal.x += pow(abs(sin(2 * M_PI * (time / 9 + normPos * numWaves * 2 + 0.8))), 2) / 96;
 		}
+#endif
 
 		normal = normalize(normal); // Normal animation finished
 
@@ -44,8 +44,8 @@ void main()
 		float blend = pow(dot(normal, R), 2);
 		outColor = max((1 - blend), 0.5) * texture(skybox, R);
 	}
-
-	else {
+#else
+	{
 		// ---------------------------- Calculate fog -----------------------------
 		float zNear = 3.0f;
 		float zFar = 128.0f;
@@ -54,4 +54,5 @@ void main()
 		depth = sqrt(depth / zFar); // sqrt gives a bit denser fog
 		outColor = vec4(depth * fogColor, depth) + (1 - depth) * vec4(0.5, 0.52, 0.55, 0.8);
 	}
+#endif
 }
@@ -1,14 +1,11 @@
 #version 400 core
 #define M_PI 3.1415926535897932384626433832795
-in vec3 inPos;
+layout(location = 0) in vec3 inPos;
 
 out vec3 Position;
 
 //uniform mat4 model; // Already in world coordinates
-uniform mat4 worldToView;
-uniform mat4 projection;
-uniform float time;
-uniform bool drawFog;
+#include "frame.glsl"
 
 void main()
 {
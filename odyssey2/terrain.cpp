@@ -1,312 +1,231 @@
-/* Code for terrain generation and filtering */
+/* Code for terrain generation */
 #include "terrain.h"
-#include "glm/vec3.hpp"
+#include "heightmap.h"
 #include "io.h"
-#include "model.h"
+#include "parallel.h"
+#include "rng.h"
+#include "terrain_cache.h"
+#include "terrain_filter.h"
+#include "terrain_mesh.h"
 #include <algorithm>
+#include <chrono>
 #include <cmath>
-#include <glm/gtc/type_ptr.hpp>
+#include <iostream>
 #include <string>
+#include <utility>
 #include <vector>
 
-// Generate terrain and save it into a Model
-Terrain::Terrain(const unsigned int world_size, const float world_xz_scale) : world_size(world_size), world_xz_scale(world_xz_scale)
+// Parse "mesh", "pull", "cdlod", "clipmap" or "tessellation", returns mesh for anything else
+Terrain_render_path parse_terrain_render_path(const std::string& name)
 {
-	terrain_model = generate_terrain();
-	const float terrain_height = max_height - min_height;
-	sea_height = min_height + terrain_height / 3;
+	if (name == "pull")
+		return Terrain_render_path::pull;
+	if (name == "cdlod")
+		return Terrain_render_path::cdlod;
+	if (name == "clipmap")
+		return Terrain_render_path::clipmap;
+	if (name == "tessellation")
+		return Terrain_render_path::tessellation;
+	if (name != "mesh")
+		std::cerr << "parse_terrain_render_path: unknown terrain renderer '" << name << "', using mesh\n";
+	return Terrain_render_path::mesh;
 }
 
-// Build Model from generated terrain
-// TODO: Move into constructor
-Model* Terrain::generate_terrain()
+// Generate terrain on the CPU or load it from the cache, call upload() to create its GPU data
+Terrain::Terrain(const unsigned int world_size, const float world_xz_scale, const Terrain_render_path render_path,
+	std::atomic<float>* progress) : render_path(render_path), world_size(world_size), world_xz_scale(world_xz_scale)
 {
-	const float tex_scale{ 1.0f / 4.0f }; // Scaling of texture coordinates
-
-	// Build procedural terrain and smooth result
-	std::vector<float> proc_terrain = diamondsquare(world_size);
-	mean(proc_terrain, 5);
-
-	const size_t vertex_count = static_cast<size_t>(world_size) * world_size;
-	const size_t triangle_count = static_cast<size_t>(world_size - 1) * static_cast<size_t>(world_size - 1) * 2ull;
-	// Since vertices are ordered in a cartesian grid the x and y positions might not be needed?
-	// It might be possible to use integer types for some or all of these values
-	std::vector<GLfloat> vertex_array(vertex_count * 3);
-	std::vector<GLfloat> normal_array(vertex_count * 3);
-	std::vector<GLfloat> tex_coord_array(vertex_count * 2);
-	std::vector<GLuint> index_array(triangle_count * 3);
-
-	// Fill vertex, texture coordinate and index array
-	for (unsigned int x = 0; x < world_size; x++)
+	// Only the mesh render path has vertices. Without a mesh the vertex format stays f32, so the setting does not
+	// change the cache key or the cached file.
+	const bool build_mesh{ render_path == Terrain_render_path::mesh };
+	const Terrain_vertex_format mesh_vertex_format{ build_mesh ?
+		usable_vertex_format(parse_terrain_vertex_format(read_value_from_ini<std::string>("vertex_format", "f32")), world_size) :
+		Terrain_vertex_format::f32 };
+	const Terrain_params params{
+		world_size,
+		world_xz_scale,
+		parse_height_format(read_value_from_ini<std::string>("height_format", "f32")),
+		mesh_vertex_format,
+		build_mesh,
+		read_value_from_ini("weight", 2000.0f), // Base weight for randomized values in diamond-square algorithm
+		read_value_from_ini("seed", 64u),
+		parse_filter_pipeline(read_value_from_ini<std::string>("filters", "median:3, mean:5"))
+	};
+	const bool use_cache{ read_value_from_ini("terrain_cache", true) };
+	if (params.build_mesh)
+		chunks = terrain_chunk_layout(world_size).chunks;
+	else if (render_path == Terrain_render_path::tessellation)
+		chunks = terrain_patch_layout(world_size);
+	const uint64_t cache_key{ terrain_cache_key(params) };
+
+	// Skip generation if terrain with the same parameters has been cached
+	Cached_terrain cached;
+	const auto load_start = std::chrono::steady_clock::now();
+	if (use_cache && load_terrain_cache(cache_key, params, cached))
 	{
-		for (unsigned int z = 0; z < world_size; z++)
-		{
-			size_t index = x + z * static_cast<size_t>(world_size);
-			float y = proc_terrain[index];
-			min_height = std::min(min_height, y);
-			max_height = std::max(max_height, y);
-
-			vertex_array[index * 3] = x * world_xz_scale;
-			vertex_array[index * 3 + 1] = y;
-			vertex_array[index * 3 + 2] = z * world_xz_scale;
-
-			// Scaled texture coordinates
-			tex_coord_array[index * 2 + 0] = static_cast<float>(x) * tex_scale;
-			tex_coord_array[index * 2 + 1] = static_cast<float>(z) * tex_scale;
-
-			if ((x != world_size - 1) && (z != world_size - 1))
-			{
-				index = (x + z * static_cast<size_t>(world_size - 1)) * 6;
-				// Triangle 1
-				index_array[index] = x + z * world_size;
-				index_array[index + 1] = x + (z + 1) * world_size;
-				index_array[index + 2] = x + 1 + z * world_size;
-				// Triangle 2
-				index_array[index + 3] = x + 1 + z * world_size;
-				index_array[index + 4] = x + (z + 1) * world_size;
-				index_array[index + 5] = x + 1 + (z + 1) * world_size;
-			}
-		}
+		const std::chrono::duration<double, std::milli> elapsed{ std::chrono::steady_clock::now() - load_start };
+		std::cout << "Terrain loaded from " << terrain_cache_filename(cache_key) << ": " << elapsed.count() << " ms\n";
+		min_height = cached.min_height;
+		max_height = cached.max_height;
+		sea_height = cached.sea_height;
+		vertex_format = cached.mesh.vertex_format;
+		heightfield = Heightfield{ cached.heights, world_size, world_xz_scale, params.height_format };
+		height_pyramid = Height_pyramid{ heightfield };
+		chunk_tree = Chunk_quadtree{ chunks, heightfield };
+		cached_mesh = cached.mesh;
+		cache_file = std::move(cached.file);
+		if (progress)
+			*progress = 1.0f;
+		return;
 	}
 
-	// Calculate normals (cross product of two vectors along current triangle)
-	const size_t offset = static_cast<size_t>(world_size) * 3;
-	for (unsigned int x = 0; x < world_size; x++)
-	{
-		for (unsigned int z = 0; z < world_size; z++)
-		{
-			size_t index = (x + z * static_cast<size_t>(world_size)) * 3;
-			// Initialize normals along edges to pointing straight up
-			if (x == 0 || (x == world_size - 1) || z == 0 || (z == world_size - 1))
-			{
-				normal_array[index] = 0.0;
-				normal_array[index + 1] = 1.0;
-				normal_array[index + 2] = 0.0;
-			}
-			// Inside edges, here the required indices are in bounds
-			else
-			{
-				glm::vec3 p0(vertex_array[index + offset], vertex_array[index + 1 + offset], vertex_array[index + 2 + offset]);
-				glm::vec3 p1(vertex_array[index - offset], vertex_array[index - offset + 1], vertex_array[index - offset + 2]);
-				glm::vec3 p2(vertex_array[index - 3], vertex_array[index - 2], vertex_array[index - 1]);
-				glm::vec3 a(p1 - p0);
-				glm::vec3 b(p2 - p0);
-				glm::vec3 normal = glm::cross(a, b);
+	// Build procedural terrain and smooth result
+	Heightmap heights = diamondsquare(world_size, params.weight, params.seed, progress, 0.5f);
+	run_filter_pipeline(heights, params.filters);
+	if (progress)
+		*progress = 0.8f;
+	const auto [min_it, max_it] = std::minmax_element(heights.begin(), heights.end());
+	min_height = *min_it;
+	max_height = *max_it;
+	const float terrain_height = max_height - min_height;
+	sea_height = min_height + terrain_height / 3;
 
-				normal_array[index] = normal.x;
-				normal_array[index + 1] = normal.y;
-				normal_array[index + 2] = normal.z;
-			}
-		}
+	heightfield = Heightfield{ heights.data(), world_size, world_xz_scale, params.height_format };
+	height_pyramid = Height_pyramid{ heightfield };
+	chunk_tree = Chunk_quadtree{ chunks, heightfield };
+	if (params.build_mesh)
+	{
+		mesh = build_terrain_mesh(heightfield, params.vertex_format, min_height, max_height);
+		vertex_format = mesh.vertex_format;
 	}
-
-	// Create Model and upload to GPU (formerly LoadModelData)
-	Model* m = new Model(std::move(vertex_array),
-		static_cast<GLsizei>(vertex_count), static_cast<GLsizei>(triangle_count) * 3);
-
-	glGenVertexArrays(1, &m->vao);
-	glGenBuffers(1, &m->vb);
-	glGenBuffers(1, &m->ib);
-	glGenBuffers(1, &m->nb);
-	glGenBuffers(1, &m->tb);
-
-	const GLsizeiptr vert_size = m->numVertices * sizeof(GLfloat);
-	glBindVertexArray(m->vao);
-	glBindBuffer(GL_ARRAY_BUFFER, m->vb);
-	glBufferData(GL_ARRAY_BUFFER, vert_size * 3, m->vertexArray.data(), GL_STATIC_DRAW);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m->ib);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, m->numIndices * sizeof(GLuint), index_array.data(), GL_STATIC_DRAW);
-	glBindBuffer(GL_ARRAY_BUFFER, m->nb);
-	glBufferData(GL_ARRAY_BUFFER, vert_size * 3, normal_array.data(), GL_STATIC_DRAW);
-	glBindBuffer(GL_ARRAY_BUFFER, m->tb);
-	glBufferData(GL_ARRAY_BUFFER, vert_size * 2, tex_coord_array.data(), GL_STATIC_DRAW);
-
-	return m;
+	if (use_cache)
+		save_terrain_cache(cache_key, world_size, heights, mesh, min_height, max_height, sea_height);
+	if (progress)
+		*progress = 1.0f;
 }
 
-// Do filter_size-point moving average filtering of arr
-void Terrain::mean(std::vector<float>& arr, const unsigned int filter_size)
+/* Upload the terrain to the GPU, requires a current OpenGL context. Creates terrain_model from the generated
+	or cached mesh for the mesh render path, height_texture for pull, cdlod and tessellation, and terrain_model
+	from chunks for tessellation. The clipmap render path uploads its own heights as the camera moves. */
+void Terrain::upload()
 {
-	size_t arr_width = (size_t)sqrt(arr.size()); // width = height of terrain array
-	std::vector<float> arr_tmp(arr.size());
-
-	// Horizontal filter
-	for (size_t row = 0; row < arr_width; row++)
-	{
-		for (size_t col = 0; col < arr_width; col++)
-		{
-			size_t i = row * arr_width + col; // Index of element being smoothed
-			float avg = arr[i]; // Initialize average with current element
-			float normalization = 1; // Normalize calculated average
-
-			for (size_t offset = 1; offset <= filter_size / 2; offset++)
-			{
-				float scale = 1 / static_cast<float>(pow(2, offset)); // Lower scaling for high offsets
-				normalization += 2 * scale;
-
-				// Left value
-				if (col < offset)
-					avg += arr[i - offset + arr_width] * scale; // Out of bounds, wrap to end of row
-				else
-					avg += arr[i - offset] * scale;
-
-				// Right value
-				if (col + offset >= arr_width)
-					avg += arr[i + offset - arr_width] * scale; // Out of bounds, wrap to start of row
-				else
-					avg += arr[i + offset] * scale;
-			}
-			arr_tmp[i] = avg / normalization;
-		}
-	}
-
-	// Vertical filter
-	for (size_t col = 0; col < arr_width; col++)
-	{
-		for (size_t row = 0; row < arr_width; row++)
-		{
-			size_t i = row * arr_width + col; // Index of element being smoothed
-			float avg = arr_tmp[i]; // Initialize average with current element
-			float normalization = 1; // Normalize calculated average
-
-			for (size_t offset = 1; offset <= filter_size / 2; offset++)
-			{
-				float scale = 1 / static_cast<float>(pow(2, offset)); // Lower scaling for high offsets
-				normalization += 2 * scale;
-
-				// Upper value
-				if (row < offset)
-					avg += arr_tmp[i - offset * arr_width + arr.size()] * scale; // Out of bounds, wrap to end of column
-				else
-					avg += arr_tmp[i - offset * arr_width] * scale;
-
-				// Lower value
-				if (row + offset >= arr_width)
-					avg += arr_tmp[i + offset * arr_width - arr.size()] * scale; // Out of bounds, wrap to start of column
-				else
-					avg += arr_tmp[i + offset * arr_width] * scale;
-			}
-			arr[i] = avg / normalization;
-		}
-	}
+	if (render_path == Terrain_render_path::pull || render_path == Terrain_render_path::cdlod ||
+		render_path == Terrain_render_path::tessellation)
+		height_texture = upload_height_texture(heightfield, min_height, max_height);
+	if (render_path == Terrain_render_path::mesh)
+		terrain_model = upload_terrain_mesh(cache_file.data() ? cached_mesh : view_terrain_mesh(mesh));
+	else if (render_path == Terrain_render_path::tessellation)
+		terrain_model = upload_terrain_patches(chunks);
+	mesh = Terrain_mesh{};
+	cache_file = Mapped_file{};
+	cached_mesh = Terrain_mesh_view{};
 }
 
-// Do median filtering on arr with filter_size number of elements in each direction
-void Terrain::median(std::vector<float>& arr, const unsigned int filter_size)
+// First hit of the ray from origin along direction within max_distance
+Ray_hit Terrain::raycast(const glm::vec3& origin, const glm::vec3& direction, const float max_distance) const
 {
-	size_t arr_width = (size_t)sqrt(arr.size()); // width = height of terrain array
-	std::vector<float> arr_tmp = std::vector<float>(arr.size());
-	std::vector<float> median(4 * ((size_t)filter_size / 2) + 1);
-
-	// Horizontal filter
-	for (size_t row = 0; row < arr_width; row++)
-	{
-		for (size_t col = 0; col < arr_width; col++)
-		{
-			size_t i = row * arr_width + col; // Index of element being smoothed
-			median[0] = arr[i];
-			for (size_t offset = 1; offset <= filter_size / 2; offset++)
-			{
-				size_t j = 4 * (offset - 1); // Index for median vector
-				// Left value
-				if (col < offset)
-					median[j + 1] = arr[i - offset + arr_width]; // Out of bounds, wrap to end of row
-				else
-					median[j + 1] = arr[i - offset];
-
-				// Right value
-				if (col + offset >= arr_width)
-					median[j + 2] = arr[i + offset - arr_width]; // Out of bounds, wrap to start of row
-				else
-					median[j + 2] = arr[i + offset];
-
-				// Upper value
-				if (row < offset)
-					median[j + 3] = arr[i - offset * arr_width + arr.size()]; // Out of bounds, wrap to end of column
-				else
-					median[j + 3] = arr[i - offset * arr_width];
-
-				// Lower value
-				if (row + offset >= arr_width)
-					median[j + 4] = arr[i + offset * arr_width - arr.size()]; // Out of bounds, wrap to start of column
-				else
-					median[j + 4] = arr[i + offset * arr_width];
-			}
-			std::sort(median.begin(), median.end());
-			arr_tmp[i] = median[median.size() / 2];
-		}
-	}
-	arr.swap(arr_tmp);
+	return height_pyramid.raycast(heightfield, origin, direction, max_distance);
 }
 
-// Return a random float number between min and max, attempting to minimize rounding errors
-static float randnum(const float max, const float min)
+// True if the segment between from and to does not pass through the terrain
+bool Terrain::line_of_sight(const glm::vec3& from, const glm::vec3& to) const
 {
-	return (max - min) * static_cast<float>(rand()) / RAND_MAX + min;
+	return height_pyramid.line_of_sight(heightfield, from, to);
 }
 
-/* Create a heightmap of size width*width using the diamond square algorithm with base offset weight
-	for the random numbers. width must be (2^n)*(2^n) in size for some integer n.*/
-std::vector<float> Terrain::diamondsquare(const unsigned int width)
+/* Run all diamond-square steps on the flat width*width heightmap terrain, wrapping indices with wrap.
+	Every point within one pass of a step only depends on points from earlier passes, so the rows of each
+	pass are split over worker threads. Random offsets are hashed from (seed, step, row, col) of the point
+	being written, which keeps the heightmap identical regardless of thread count and platform.
+	Only the last column of a row can wrap, so it is peeled off and the remaining inner loops index
+	straight into row pointers without any wrapping. */
+template <typename Wrap_t>
+static void diamondsquare_steps(Heightmap& terrain, const Wrap_t wrap, float weight, const uint32_t seed,
+	std::atomic<float>* progress, const float progress_end)
 {
-	float weight{ read_value_from_ini("weight", 2000.0f) }; // Base weight for randomized values in diamond-square algorithm
-	const unsigned int seed{ read_value_from_ini("seed", 64u) };
-	srand(seed);
-	std::vector<std::vector<float>> terrain{ (size_t)width, std::vector<float>((size_t)width) };
-
-	/* Initialize corner values. Since the width for this implementation is 2^n rather than 2^n+1,
-		the right and lower edges are "cut off" and terrain[0] wraps around. */
-	terrain[0][0] = randnum(weight, -weight);
+	const size_t width{ wrap.width };
+	float* const data{ terrain.data() };
 
 	// Iterate over step lengths.
-	for (unsigned int step = width; step > 1; step /= 2)
+	for (size_t step = width; step > 1; step /= 2)
 	{
+		const size_t half{ step / 2 };
+		const uint32_t key_step{ static_cast<uint32_t>(step) };
+		const size_t last_col{ width - step }; // Last column in a row where the square's right edge wraps
+
 		// Do diamond step for current step length
 		weight /= 2;
-		for (size_t row = 0; row < width; row += step)
-		{
-			for (size_t col = 0; col < width; col += step)
+		parallel_for(0, width / step, [&](const size_t first_row, const size_t last_row)
 			{
-				// Index upper/lower right and left corners of the square area being worked on, the mean of the corner
-				// values give the base displacement for the current point being calculated. Wrap-around if out of bounds.
-				terrain[row + step / 2][col + step / 2] = (terrain[row][col] +
-															  terrain[row][(col + step) % width] +
-															  terrain[(row + step) % width][col] +
-															  terrain[(row + step) % width][(col + step) % width]) /
-															  4 +
-														  randnum(weight, -weight);
-			}
-		}
-		// Do square step for the upper and left points
-		for (size_t row = 0; row < width; row += step)
-		{
-			for (size_t col = 0; col < width; col += step)
+				for (size_t row = first_row * step; row < last_row * step; row += step)
+				{
+					// The mean of the corner values of the square area being worked on give the base
+					// displacement for the center point being calculated.
+					const float* upper{ data + row * width };
+					const float* lower{ data + wrap(row + step) * width };
+					float* center{ data + (row + half) * width };
+					for (size_t col = 0; col < last_col; col += step)
+					{
+						center[col + half] = (upper[col] + upper[col + step] + lower[col] + lower[col + step]) / 4 +
+							hash_randnum(seed, key_step, row + half, col + half, weight, -weight);
+					}
+					center[last_col + half] = (upper[last_col] + upper[0] + lower[last_col] + lower[0]) / 4 +
+						hash_randnum(seed, key_step, row + half, last_col + half, weight, -weight);
+				}
+			});
+
+		// Do square step for the upper and left points of each square
+		parallel_for(0, width / step, [&](const size_t first_row, const size_t last_row)
 			{
-				size_t r_left = row + step / 2;
-				size_t c_up = col + step / 2;
+				for (size_t row = first_row * step; row < last_row * step; row += step)
+				{
+					const float* above{ data + wrap(row - half + width) * width }; // Centers of the squares above
+					float* corner_row{ data + row * width }; // Corners, receives the upper points
+					float* center_row{ data + (row + half) * width }; // Centers, receives the left points
+					const float* below{ data + wrap(row + step) * width }; // Corners of the squares below
+
+					// Upper points, the mean of the points above, left, right and below
+					for (size_t col = 0; col < last_col; col += step)
+					{
+						const size_t c_up{ col + half };
+						corner_row[c_up] = (above[c_up] + corner_row[col] + corner_row[col + step] + center_row[c_up]) / 4 +
+							hash_randnum(seed, key_step, row, c_up, weight, -weight);
+					}
+					corner_row[last_col + half] = (above[last_col + half] + corner_row[last_col] + corner_row[0] + center_row[last_col + half]) / 4 +
+						hash_randnum(seed, key_step, row, last_col + half, weight, -weight);
+
+					// Left points, the first column wraps to the center of the last square in the row
+					center_row[0] = (corner_row[0] + center_row[last_col + half] + center_row[half] + below[0]) / 4 +
+						hash_randnum(seed, key_step, row + half, 0, weight, -weight);
+					for (size_t col = step; col < width; col += step)
+					{
+						center_row[col] = (corner_row[col] + center_row[col - half] + center_row[col + half] + below[col]) / 4 +
+							hash_randnum(seed, key_step, row + half, col, weight, -weight);
+					}
+				}
+			});
+
+		// Each step writes four times as many points as the previous one
+		if (progress)
+			*progress = progress_end * static_cast<float>(width / step) * (width / step) / (static_cast<float>(width) * width / 4);
+	}
+}
 
-				// Being lazy here and making sure all indices are in bounds, even if some will never go out of bounds.
-				float mean_up = (terrain[(row - step / 2 + width) % width][c_up] + // Above, make sure it is not negative
-									terrain[row][(c_up - step / 2 + width) % width] + // Left, make sure it is not negative
-									terrain[row][(c_up + step / 2) % width] + // Right
-									terrain[(r_left % width)][c_up]) /
-								4; // Below
-				float mean_left = (terrain[(r_left - step / 2 + width) % width][col] +
-									  terrain[r_left][(col - step / 2 + width) % width] +
-									  terrain[r_left][c_up % width] +
-									  terrain[(r_left + step / 2) % width][col]) /
-								  4;
+/* Create a heightmap of size width*width using the diamond square algorithm with base offset weight
+	for the random numbers. width must be (2^n)*(2^n) in size for some integer n. */
+Heightmap Terrain::diamondsquare(const unsigned int width, const float weight, const unsigned int seed,
+	std::atomic<float>* progress, const float progress_end)
+{
+	Heightmap terrain(static_cast<size_t>(width) * width);
 
-				terrain[row][c_up] = mean_up + randnum(weight, -weight);
-				terrain[r_left][col] = mean_left + randnum(weight, -weight);
-			}
-		}
-	}
+	/* Initialize corner values. Since the width for this implementation is 2^n rather than 2^n+1,
+		the right and lower edges are "cut off" and terrain[0] wraps around. */
+	terrain[0] = hash_randnum(seed, 0, 0, 0, weight, -weight);
 
-	// Flatten vector
-	std::vector<float> temp;
-	for (const auto& vec : terrain)
-		temp.insert(temp.end(), vec.begin(), vec.end());
+	if (is_power_of_two(width))
+		diamondsquare_steps(terrain, Wrap<true>(width), weight, seed, progress, progress_end);
+	else
+		diamondsquare_steps(terrain, Wrap<false>(width), weight, seed, progress, progress_end);
 
-	return temp;
+	return terrain;
 }
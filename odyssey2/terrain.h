@@ -1,16 +1,69 @@
-/* Code for terrain generation and filtering */
+/* Code for terrain generation */
 #pragma once
+#include "chunk_quadtree.h"
+#include "height_pyramid.h"
+#include "heightfield.h"
+#include "heightmap.h"
+#include "height_texture.h"
+#include "mapped_file.h"
 #include "model.h"
+#include "terrain_mesh.h"
+#include <atomic>
+#include <cfloat>
 #include <string>
 #include <vector>
 
-// Generate terrain and save it into a Model
+// How the terrain is drawn
+enum class Terrain_render_path
+{
+	mesh, // Indexed interleaved vertex buffer built on the CPU
+	pull, // Vertices rebuilt in the vertex shader from a heightmap texture, no vertex or index buffers
+	cdlod, // Like pull, with distance dependent level of detail
+	clipmap, // Nested grids around the camera from a heightmap texture that is updated as the camera moves
+	tessellation // Coarse grid of patches tessellated on the GPU by projected edge length, heights from a heightmap texture
+};
+
+// Parse "mesh", "pull", "cdlod", "clipmap" or "tessellation", returns mesh for anything else
+Terrain_render_path parse_terrain_render_path(const std::string& name);
+
+// Generate terrain on the CPU and upload it into a Model or a heightmap texture
 class Terrain
 {
 public:
-	Terrain(const unsigned int world_size, const float world_xz_scale);
+	/* Generate heightmap and mesh, does not need an OpenGL context so it can be run on a worker thread.
+		Terrain generated earlier with the same parameters is mapped from the on-disk cache instead.
+		No mesh is built for the other render paths. If progress is given it is updated from 0 to 1 as generation proceeds. */
+	Terrain(const unsigned int world_size, const float world_xz_scale, const Terrain_render_path render_path,
+		std::atomic<float>* progress = nullptr);
+
+	/* Upload the terrain to the GPU, requires a current OpenGL context. Creates terrain_model from the generated
+		or cached mesh for the mesh render path, height_texture for pull, cdlod and tessellation, and terrain_model
+		from chunks for tessellation. The clipmap render path uploads its own heights as the camera moves. */
+	void upload();
+
+	// First hit of the ray from origin along direction within max_distance
+	Ray_hit raycast(const glm::vec3& origin, const glm::vec3& direction, const float max_distance = FLT_MAX) const;
+
+	// True if the segment between from and to does not pass through the terrain
+	bool line_of_sight(const glm::vec3& from, const glm::vec3& to) const;
+
+	// Generated mesh, empty if the terrain was loaded from the cache. Released by upload().
+	Terrain_mesh mesh{};
 
-	Model* terrain_model;
+	// GPU data of the terrain, only the one for render_path is created, none for clipmap
+	Model* terrain_model{ nullptr };
+	Height_texture height_texture{};
+
+	/* Chunks of terrain_model, each drawn with one call, and their bounding boxes. Patches of terrain_model
+		for the tessellation render path, empty for the others without a mesh. */
+	std::vector<Terrain_chunk> chunks{};
+	Chunk_quadtree chunk_tree{};
+
+	// Heights of the terrain on the CPU, used for collision
+	Heightfield heightfield{};
+
+	// Min/max pyramid over heightfield for raycasts
+	Height_pyramid height_pyramid{};
 
 	// Lowest point in generated terrain
 	float min_height{ FLT_MAX };
@@ -21,6 +74,11 @@ public:
 	// y coordinate of sea level
 	float sea_height{};
 
+	Terrain_render_path render_path;
+
+	// Vertex layout of terrain_model, the terrain shader needs it to decode positions
+	Terrain_vertex_format vertex_format{ Terrain_vertex_format::f32 };
+
 	// Size of terrain in number of vertices along one side (world is square)
 	const unsigned int world_size;
 
@@ -28,17 +86,12 @@ public:
 	const float world_xz_scale;
 
 private:
-	// Build Model from generated terrain
-	Model* generate_terrain();
-
-	// Do filter_size-point moving average filtering on arr
-	static void mean(std::vector<float>& arr, const unsigned int filter_size);
-
-	// Do median filtering on arr with filter_size number of elements in each direction
-	// TODO: Terrain::median is unused
-	static void median(std::vector<float>& arr, const unsigned int filter_size);
+	/* Create a heightmap of size width*width using the diamond square algorithm with base offset weight
+		for the random numbers and the given seed. progress is raised from 0 to progress_end. */
+	Heightmap diamondsquare(const unsigned int width, const float weight, const unsigned int seed,
+		std::atomic<float>* progress, const float progress_end);
 
-	/* Create a heightmap of size width*width using the diamond square algorithm with
-		base offset weight for the random numbers. */
-	std::vector<float> diamondsquare(const unsigned int width);
+	// Mapping of the cache file and the mesh inside it, used instead of mesh if the terrain was loaded from the cache
+	Mapped_file cache_file{};
+	Terrain_mesh_view cached_mesh{};
 };
@@ -0,0 +1,177 @@
+/* Persistent on-disk cache of generated terrain, loaded through a read-only memory mapping */
+#include "terrain_cache.h"
+#include "cache_file.h"
+#include "heightmap.h"
+#include "mapped_file.h"
+#include "terrain_mesh.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <ostream>
+#include <string>
+#include <utility>
+
+// Bump whenever the file layout or the generated data changes, old files are then regenerated
+static constexpr uint32_t cache_version{ 5 };
+static constexpr char cache_magic[8]{ 'O', 'D', 'Y', '2', 'T', 'E', 'R', 'R' };
+
+// Sections are aligned so the mapped arrays can be used directly with SIMD loads
+static constexpr uint64_t section_alignment{ 64 };
+
+// Data sections of a cache file, in file order
+enum Cache_section : size_t
+{
+	heights_section,
+	vertex_section,
+	index_section,
+	section_count
+};
+
+/* Fixed size header at the start of a cache file. All values are stored in native byte order,
+	so cache files are only meant to be read on the machine that wrote them. */
+struct Cache_header
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t world_size;
+	uint64_t key;
+	float min_height;
+	float max_height;
+	float sea_height;
+	uint32_t vertex_format; // Terrain_vertex_format of the vertex section
+	uint64_t section_offset[section_count]; // Byte offset from the start of the file
+	uint64_t section_size[section_count]; // Size in bytes
+};
+
+/* Size in bytes of each section for a world_size*world_size terrain with vertices in vertex_format,
+	the mesh sections are empty if it has no mesh */
+static void expected_section_sizes(const unsigned int world_size, const Terrain_vertex_format vertex_format,
+	const bool has_mesh, uint64_t (&sizes)[section_count])
+{
+	const Terrain_chunk_layout layout{ terrain_chunk_layout(world_size) };
+	sizes[heights_section] = static_cast<uint64_t>(world_size) * world_size * sizeof(float);
+	sizes[vertex_section] = has_mesh ? layout.vertex_count * terrain_vertex_size(vertex_format) : 0;
+	sizes[index_section] = has_mesh ? layout.index_count * sizeof(GLushort) : 0;
+}
+
+// 64-bit FNV-1a hash of the cache format version and all generation parameters
+uint64_t terrain_cache_key(const Terrain_params& params)
+{
+	uint64_t hash{ fnv1a_offset_basis };
+	fnv1a(hash, &cache_version, sizeof(cache_version));
+	fnv1a(hash, &params.world_size, sizeof(params.world_size));
+	fnv1a(hash, &params.world_xz_scale, sizeof(params.world_xz_scale));
+	const uint32_t height_format{ static_cast<uint32_t>(params.height_format) };
+	fnv1a(hash, &height_format, sizeof(height_format));
+	const uint32_t vertex_format{ static_cast<uint32_t>(params.vertex_format) };
+	fnv1a(hash, &vertex_format, sizeof(vertex_format));
+	const uint32_t build_mesh{ params.build_mesh ? 1u : 0u };
+	fnv1a(hash, &build_mesh, sizeof(build_mesh));
+	fnv1a(hash, &params.weight, sizeof(params.weight));
+	fnv1a(hash, &params.seed, sizeof(params.seed));
+	const uint32_t filter_count{ static_cast<uint32_t>(params.filters.size()) };
+	fnv1a(hash, &filter_count, sizeof(filter_count));
+	for (const Filter_stage& stage : params.filters)
+	{
+		const uint32_t stage_key[2]{ static_cast<uint32_t>(stage.type), stage.size };
+		fnv1a(hash, stage_key, sizeof(stage_key));
+	}
+	return hash;
+}
+
+// Path of the cache file for key, in the cache directory next to settings.ini
+std::string terrain_cache_filename(const uint64_t key)
+{
+	return cache_filename("terrain", key);
+}
+
+/* Map the cache file for key into cached. Returns false if the file is missing, truncated,
+	written by another format version or for other parameters, in which case the terrain must be generated. */
+bool load_terrain_cache(const uint64_t key, const Terrain_params& params, Cached_terrain& cached)
+{
+	const unsigned int world_size{ params.world_size };
+	const Terrain_vertex_format vertex_format{ params.vertex_format };
+	const std::string filename{ terrain_cache_filename(key) };
+	Mapped_file file{ filename };
+	if (!file.data())
+		return false; // Not generated yet
+
+	Cache_header header{};
+	if (file.size() < sizeof(header))
+	{
+		std::cerr << "load_terrain_cache: ignoring truncated file " << filename << "\n";
+		return false;
+	}
+	std::memcpy(&header, file.data(), sizeof(header));
+	if (std::memcmp(header.magic, cache_magic, sizeof(cache_magic)) != 0 || header.version != cache_version ||
+		header.key != key || header.world_size != world_size || header.vertex_format != static_cast<uint32_t>(vertex_format))
+	{
+		std::cerr << "load_terrain_cache: ignoring file " << filename << " from another version or world\n";
+		return false;
+	}
+
+	uint64_t expected_sizes[section_count];
+	expected_section_sizes(world_size, vertex_format, params.build_mesh, expected_sizes);
+	for (size_t section = 0; section < section_count; section++)
+	{
+		if (header.section_size[section] != expected_sizes[section] || header.section_offset[section] % section_alignment != 0 ||
+			header.section_offset[section] > file.size() || header.section_size[section] > file.size() - header.section_offset[section])
+		{
+			std::cerr << "load_terrain_cache: ignoring corrupt file " << filename << "\n";
+			return false;
+		}
+	}
+
+	const unsigned char* const base{ file.data() };
+	cached.heights = reinterpret_cast<const float*>(base + header.section_offset[heights_section]);
+	cached.mesh = Terrain_mesh_view{
+		vertex_format,
+		base + header.section_offset[vertex_section],
+		reinterpret_cast<const GLushort*>(base + header.section_offset[index_section]),
+		static_cast<size_t>(header.section_size[vertex_section] / terrain_vertex_size(vertex_format)),
+		static_cast<size_t>(header.section_size[index_section] / sizeof(GLushort))
+	};
+	cached.min_height = header.min_height;
+	cached.max_height = header.max_height;
+	cached.sea_height = header.sea_height;
+	cached.file = std::move(file);
+	return true;
+}
+
+/* Write generated terrain to the cache file for key. The file is written under a temporary name
+	and renamed when complete, so a partially written file is never loaded. */
+void save_terrain_cache(const uint64_t key, const unsigned int world_size, const Heightmap& heights,
+	const Terrain_mesh& mesh, const float min_height, const float max_height, const float sea_height)
+{
+	Cache_header header{};
+	std::memcpy(header.magic, cache_magic, sizeof(cache_magic));
+	header.version = cache_version;
+	header.world_size = world_size;
+	header.key = key;
+	header.min_height = min_height;
+	header.max_height = max_height;
+	header.sea_height = sea_height;
+	header.vertex_format = static_cast<uint32_t>(mesh.vertex_format);
+	expected_section_sizes(world_size, mesh.vertex_format, !mesh.index_array.empty(), header.section_size);
+	uint64_t offset{ sizeof(header) };
+	for (size_t section = 0; section < section_count; section++)
+	{
+		offset = (offset + section_alignment - 1) / section_alignment * section_alignment;
+		header.section_offset[section] = offset;
+		offset += header.section_size[section];
+	}
+
+	const void* const section_data[section_count]{ heights.data(), view_terrain_mesh(mesh).vertices, mesh.index_array.data() };
+	write_cache_file(terrain_cache_filename(key), [&header, &section_data](std::ostream& out)
+		{
+			out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+			const char zeros[section_alignment]{};
+			uint64_t position{ sizeof(header) };
+			for (size_t section = 0; section < section_count; section++)
+			{
+				out.write(zeros, static_cast<std::streamsize>(header.section_offset[section] - position));
+				out.write(static_cast<const char*>(section_data[section]), static_cast<std::streamsize>(header.section_size[section]));
+				position = header.section_offset[section] + header.section_size[section];
+			}
+		}, "save_terrain_cache");
+}
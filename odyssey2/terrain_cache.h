@@ -0,0 +1,50 @@
+/* Persistent on-disk cache of generated terrain, loaded through a read-only memory mapping */
+#pragma once
+#include "heightfield.h"
+#include "heightmap.h"
+#include "mapped_file.h"
+#include "terrain_filter.h"
+#include "terrain_mesh.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Everything that determines the generated terrain, hashed into the cache key
+struct Terrain_params
+{
+	unsigned int world_size;
+	float world_xz_scale;
+	Height_format height_format; // Meshes are built from the stored, possibly quantized, heights
+	Terrain_vertex_format vertex_format; // Always f32 without a mesh, the cache checks it against the cached mesh
+	bool build_mesh; // False if the terrain is drawn without a mesh, only the heights are cached then
+	float weight;
+	unsigned int seed;
+	std::vector<Filter_stage> filters;
+};
+
+// Terrain loaded from the cache, the arrays point into file and stay valid as long as it is mapped
+struct Cached_terrain
+{
+	Mapped_file file{};
+	const float* heights{ nullptr }; // world_size*world_size heights, row-major like Heightmap
+	Terrain_mesh_view mesh{}; // Empty if the terrain was cached without a mesh
+	float min_height{};
+	float max_height{};
+	float sea_height{};
+};
+
+// 64-bit FNV-1a hash of the cache format version and all generation parameters
+uint64_t terrain_cache_key(const Terrain_params& params);
+
+// Path of the cache file for key, in the cache directory next to settings.ini
+std::string terrain_cache_filename(const uint64_t key);
+
+/* Map the cache file for key into cached. Returns false if the file is missing, truncated,
+	written by another format version or for other parameters, in which case the terrain must be generated. */
+bool load_terrain_cache(const uint64_t key, const Terrain_params& params, Cached_terrain& cached);
+
+/* Write generated terrain to the cache file for key. The file is written under a temporary name
+	and renamed when complete, so a partially written file is never loaded. */
+void save_terrain_cache(const uint64_t key, const unsigned int world_size, const Heightmap& heights,
+	const Terrain_mesh& mesh, const float min_height, const float max_height, const float sea_height);
@@ -0,0 +1,155 @@
+/* Geometry clipmap terrain: nested grids centred on the camera, drawn from a toroidally updated heightmap texture */
+#include "terrain_clipmap.h"
+#include "frustum.h"
+#include "heightfield.h"
+#include "height_texture.h"
+#include <glad/glad.h>
+#include <glm/vec3.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+// Most levels of a clipmap, level 15 already uses every 32768th grid point
+static constexpr uint32_t max_levels{ 16 };
+
+// Texels of a level's texture layer before the first vertex of its grid
+static constexpr int32_t texture_border{ (Terrain_clipmap::texture_size - Terrain_clipmap::grid_cells) / 2 };
+
+/* Create the clipmap texture for heightfield with enough levels to reach far from the camera, requires a current
+	OpenGL context. Heights of 16-bit height formats are stored as R16 between min_height and max_height, f32 as R32F.
+	The texture is filled by the first update(). */
+Terrain_clipmap::Terrain_clipmap(const Heightfield& heightfield, const float min_height, const float max_height, const float far) :
+	min_height(min_height), max_height(max_height)
+{
+	// Each level reaches half its grid from the camera, twice as far as the one before it
+	uint32_t level_count{ 1 };
+	while (level_count < max_levels && grid_cells / 2 * static_cast<float>(1u << (level_count - 1)) * heightfield.xz_scale() < far)
+		level_count++;
+	levels.resize(level_count, Level{ 0, 0, false });
+
+	texture = create_height_texture(GL_TEXTURE_2D_ARRAY, heightfield.format(), min_height, max_height, texture_size,
+		static_cast<GLsizei>(level_count));
+}
+
+// Centre the levels on position and upload the heights that came into view since the last update
+void Terrain_clipmap::update(const Heightfield& heightfield, const glm::vec3& position)
+{
+	for (uint32_t level = 0; level < levels.size(); level++)
+	{
+		// Grid position of the camera in the grid of this level. The origin is kept even so the level's edge
+		// runs along grid points of the next coarser level.
+		const float step{ heightfield.xz_scale() * static_cast<float>(1u << level) };
+		const int32_t origin_x{ 2 * static_cast<int32_t>(std::floor((position.x / step - grid_cells / 2) / 2.0f)) };
+		const int32_t origin_z{ 2 * static_cast<int32_t>(std::floor((position.z / step - grid_cells / 2) / 2.0f)) };
+		Level& current{ levels[level] };
+		const int32_t dx{ origin_x - current.origin_x };
+		const int32_t dz{ origin_z - current.origin_z };
+		if (current.uploaded && dx == 0 && dz == 0)
+			continue;
+
+		// The texture layer holds the texture_size * texture_size level grid points from origin - texture_border
+		const int32_t first_x{ origin_x - texture_border };
+		const int32_t first_z{ origin_z - texture_border };
+		if (!current.uploaded || std::abs(dx) >= texture_size || std::abs(dz) >= texture_size)
+			upload(heightfield, level, first_x, first_z, texture_size, texture_size);
+		else
+		{
+			// Rows that came into view across the whole layer, then columns that came into view in the other rows
+			if (dz > 0)
+				upload(heightfield, level, first_x, first_z + texture_size - dz, texture_size, dz);
+			else if (dz < 0)
+				upload(heightfield, level, first_x, first_z, texture_size, -dz);
+			const int32_t rows_z{ dz > 0 ? first_z : first_z - dz };
+			const int32_t rows{ texture_size - std::abs(dz) };
+			if (dx > 0)
+				upload(heightfield, level, first_x + texture_size - dx, rows_z, dx, rows);
+			else if (dx < 0)
+				upload(heightfield, level, first_x, rows_z, -dx, rows);
+		}
+		current = Level{ origin_x, origin_z, true };
+	}
+}
+
+// Replace the contents of rects with the rectangles in frustum to draw after the last update
+void Terrain_clipmap::select(const Heightfield& heightfield, const Frustum& frustum, std::vector<Clipmap_rect>& rects) const
+{
+	rects.clear();
+	const auto add_rect = [&](const uint32_t level, const int32_t x, const int32_t z, const int32_t cells_x, const int32_t cells_z)
+	{
+		if (cells_x <= 0 || cells_z <= 0)
+			return;
+		const float step{ heightfield.xz_scale() * static_cast<float>(1u << level) };
+		const glm::vec3 min{ static_cast<float>(x) * step, min_height, static_cast<float>(z) * step };
+		const glm::vec3 max{ static_cast<float>(x + cells_x) * step, max_height, static_cast<float>(z + cells_z) * step };
+		if (intersects(frustum, min, max))
+			rects.push_back(Clipmap_rect{ x, z, level, static_cast<uint32_t>(cells_x), static_cast<uint32_t>(cells_z) });
+	};
+
+	if (levels.empty())
+		return;
+	add_rect(0, levels[0].origin_x, levels[0].origin_z, grid_cells, grid_cells);
+
+	// Coarser levels are rings around the area of the level before them, which covers half their grid
+	constexpr int32_t hole_cells{ grid_cells / 2 };
+	for (uint32_t level = 1; level < levels.size(); level++)
+	{
+		const Level& ring{ levels[level] };
+		const int32_t hole_x{ levels[level - 1].origin_x / 2 - ring.origin_x };
+		const int32_t hole_z{ levels[level - 1].origin_z / 2 - ring.origin_z };
+		add_rect(level, ring.origin_x, ring.origin_z, grid_cells, hole_z);
+		add_rect(level, ring.origin_x, ring.origin_z + hole_z + hole_cells, grid_cells, grid_cells - hole_z - hole_cells);
+		add_rect(level, ring.origin_x, ring.origin_z + hole_z, hole_x, hole_cells);
+		add_rect(level, ring.origin_x + hole_x + hole_cells, ring.origin_z + hole_z, grid_cells - hole_x - hole_cells, hole_cells);
+	}
+}
+
+/* Upload the width * depth level grid points of level starting at level grid position (x, z) into their
+	toroidal texels, which the caller has to make sure are not used by other points of the level */
+void Terrain_clipmap::upload(const Heightfield& heightfield, const uint32_t level, const int32_t x, const int32_t z,
+	const int32_t width, const int32_t depth)
+{
+	const int64_t grid_width{ heightfield.width() };
+	// Grid point of level grid position p, the heightfield repeats in both directions
+	const auto wrap = [grid_width, level](const int64_t p)
+		{
+			return static_cast<size_t>((p * (int64_t{ 1 } << level) % grid_width + grid_width) % grid_width);
+		};
+
+	const GLint unpack_alignment{ begin_height_upload() };
+	glBindTexture(GL_TEXTURE_2D_ARRAY, texture.id);
+
+	// The rectangle wraps around the edges of the texture layer at most once in each direction
+	for (int32_t piece_z = z; piece_z < z + depth;)
+	{
+		const int32_t texel_z{ piece_z & (texture_size - 1) };
+		const int32_t piece_depth{ std::min(z + depth - piece_z, texture_size - texel_z) };
+		for (int32_t piece_x = x; piece_x < x + width;)
+		{
+			const int32_t texel_x{ piece_x & (texture_size - 1) };
+			const int32_t piece_width{ std::min(x + width - piece_x, texture_size - texel_x) };
+			heights.resize(static_cast<size_t>(piece_width) * piece_depth);
+			for (int32_t row = 0; row < piece_depth; row++)
+			{
+				const size_t grid_z{ wrap(piece_z + row) };
+				for (int32_t column = 0; column < piece_width; column++)
+					heights[static_cast<size_t>(row) * piece_width + column] = heightfield.at(wrap(piece_x + column), grid_z);
+			}
+
+			if (texture.unorm16)
+			{
+				quantized.resize(heights.size());
+				quantize_heights(texture, heights.data(), heights.size(), quantized.data());
+				glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, texel_x, texel_z, static_cast<GLint>(level), piece_width, piece_depth, 1,
+					GL_RED, GL_UNSIGNED_SHORT, quantized.data());
+			}
+			else
+				glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, texel_x, texel_z, static_cast<GLint>(level), piece_width, piece_depth, 1,
+					GL_RED, GL_FLOAT, heights.data());
+			piece_x += piece_width;
+		}
+		piece_z += piece_depth;
+	}
+	end_height_upload(unpack_alignment);
+}
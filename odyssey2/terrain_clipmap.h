@@ -0,0 +1,82 @@
+/* Geometry clipmap terrain: nested grids centred on the camera, drawn from a toroidally updated heightmap texture */
+#pragma once
+#include "frustum.h"
+#include "heightfield.h"
+#include "height_texture.h"
+#include <glm/vec3.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Rectangle of cells of one clipmap level, drawn as rows of a regular grid pulled from the clipmap texture
+struct Clipmap_rect
+{
+	int32_t x; // Column of the first vertex in the grid of its level, whose step is 2^level grid points
+	int32_t z; // Row of the first vertex in the grid of its level
+	uint32_t level;
+	uint32_t cells_x; // Cells along x
+	uint32_t cells_z; // Cells along z, one instance per row
+};
+
+/* Geometry clipmap (Losasso and Hoppe 2004) over a Heightfield. Level l is a grid of grid_cells * grid_cells cells
+	using every 2^l-th grid point, centred on the camera, and is drawn as a ring around the hole covered by level l-1.
+	The heights of each level are kept in one layer of a texture array that is addressed toroidally, so when the
+	camera moves only the rows and columns that came into view are uploaded. The heightfield is treated as repeating,
+	like the generated terrain, so the grids may reach past its edges. Vertices blend towards the grid of the next
+	coarser level near the outer edge of their level, so the rings meet without cracks. */
+class Terrain_clipmap
+{
+public:
+	// Texels along each side of a level's texture layer, a power of two so the shader can wrap with a mask
+	static constexpr int32_t texture_size{ 256 };
+
+	// Cells along each side of a level's grid, the texture has a border of four texels around it for normals and blending
+	static constexpr int32_t grid_cells{ texture_size - 8 };
+
+	// Cells at the outer edge of a level over which its vertices blend to the next coarser level
+	static constexpr int32_t morph_cells{ grid_cells / 10 };
+
+	Terrain_clipmap() = default;
+
+	/* Create the clipmap texture for heightfield with enough levels to reach far from the camera, requires a current
+		OpenGL context. Heights of 16-bit height formats are stored as R16 between min_height and max_height, f32 as R32F.
+		The texture is filled by the first update(). */
+	Terrain_clipmap(const Heightfield& heightfield, const float min_height, const float max_height, const float far);
+
+	// Centre the levels on position and upload the heights that came into view since the last update
+	void update(const Heightfield& heightfield, const glm::vec3& position);
+
+	// Replace the contents of rects with the rectangles in frustum to draw after the last update
+	void select(const Heightfield& heightfield, const Frustum& frustum, std::vector<Clipmap_rect>& rects) const;
+
+	/* Level grid position of the first vertex of level, the level covers grid_cells * grid_cells cells from there.
+		Always even, so it is a grid point of the next coarser level. */
+	int32_t origin_x(const uint32_t level) const { return levels[level].origin_x; }
+	int32_t origin_z(const uint32_t level) const { return levels[level].origin_z; }
+
+	size_t level_count() const { return levels.size(); }
+
+	// Texture array with one texture_size * texture_size layer per level
+	Height_texture texture{};
+
+private:
+	struct Level
+	{
+		int32_t origin_x;
+		int32_t origin_z;
+		bool uploaded; // False until the texture layer was filled
+	};
+
+	/* Upload the width * depth level grid points of level starting at level grid position (x, z) into their
+		toroidal texels, which the caller has to make sure are not used by other points of the level */
+	void upload(const Heightfield& heightfield, const uint32_t level, const int32_t x, const int32_t z,
+		const int32_t width, const int32_t depth);
+
+	std::vector<Level> levels{};
+	float min_height{ 0.0f };
+	float max_height{ 0.0f };
+
+	// Reused by upload()
+	std::vector<float> heights{};
+	std::vector<uint16_t> quantized{};
+};
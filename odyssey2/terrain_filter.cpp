@@ -0,0 +1,444 @@
+/* Filters for generated heightmaps and the configurable filter pipeline built from them */
+#include "terrain_filter.h"
+#include "heightmap.h"
+#include "parallel.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Symmetric separable filter kernel, weights[0] is the center element and weights[k] the elements k steps away
+struct Separable_kernel
+{
+	std::vector<float> weights;
+	float normalization; // Sum of all kernel elements, each filtered value is divided by it
+};
+
+// Copy the width elements of src into padded with radius wrapped-around elements on each side
+static void pad_row(const float* src, const size_t width, const size_t radius, std::vector<float>& padded)
+{
+	std::copy(src, src + width, padded.begin() + radius);
+	for (size_t i = 0; i < radius; i++)
+	{
+		padded[radius - 1 - i] = src[width - 1 - i % width]; // Left of first element, wrap to end of row
+		padded[radius + width + i] = src[i % width]; // Right of last element, wrap to start of row
+	}
+}
+
+/* Filter arr with the symmetric separable kernel weights (weights[0] is the center element, weights[k] the
+	elements k steps away in both directions), dividing each sum by normalization. Indices wrap around
+	the edges of the heightmap. Both passes read rows contiguously so the inner loops vectorize across
+	columns: the horizontal pass copies each row into a buffer padded with its wrapped neighbours, and
+	the vertical pass adds whole rows offset up and down. The vertical pass works on column tiles so that
+	the rows of the kernel stay in cache for consecutive output rows. Rows are split over worker threads. */
+static void convolve_separable(Heightmap& arr, const std::vector<float>& weights, const float normalization)
+{
+	constexpr size_t tile_width{ 2048 }; // Columns per vertical pass tile (8 KiB per row)
+	const size_t arr_width = static_cast<size_t>(sqrt(arr.size())); // width = height of terrain array
+	const size_t radius{ weights.size() - 1 };
+	Heightmap arr_tmp(arr.size());
+
+	// Horizontal filter
+	parallel_for(0, arr_width, [&](const size_t first_row, const size_t last_row)
+		{
+			std::vector<float> padded(arr_width + 2 * radius);
+			for (size_t row = first_row; row < last_row; row++)
+			{
+				const float* src{ arr.data() + row * arr_width };
+				float* dst{ arr_tmp.data() + row * arr_width };
+				pad_row(src, arr_width, radius, padded);
+				const float* center{ padded.data() + radius };
+
+				for (size_t col = 0; col < arr_width; col++)
+					dst[col] = center[col] * weights[0]; // Initialize average with current element
+				for (size_t offset = 1; offset <= radius; offset++)
+				{
+					const float scale{ weights[offset] };
+					const float* left{ center - offset };
+					const float* right{ center + offset };
+					for (size_t col = 0; col < arr_width; col++)
+					{
+						dst[col] += left[col] * scale; // Left value
+						dst[col] += right[col] * scale; // Right value
+					}
+				}
+				for (size_t col = 0; col < arr_width; col++)
+					dst[col] /= normalization;
+			}
+		});
+
+	// Vertical filter
+	parallel_for(0, arr_width, [&](const size_t first_row, const size_t last_row)
+		{
+			for (size_t tile = 0; tile < arr_width; tile += tile_width)
+			{
+				const size_t tile_end{ std::min(tile + tile_width, arr_width) };
+				for (size_t row = first_row; row < last_row; row++)
+				{
+					float* dst{ arr.data() + row * arr_width };
+					const float* src{ arr_tmp.data() + row * arr_width };
+					for (size_t col = tile; col < tile_end; col++)
+						dst[col] = src[col] * weights[0]; // Initialize average with current element
+					for (size_t offset = 1; offset <= radius; offset++)
+					{
+						const float scale{ weights[offset] };
+						const float* upper{ arr_tmp.data() + ((row + arr_width - offset % arr_width) % arr_width) * arr_width };
+						const float* lower{ arr_tmp.data() + ((row + offset) % arr_width) * arr_width };
+						for (size_t col = tile; col < tile_end; col++)
+						{
+							dst[col] += upper[col] * scale; // Upper value
+							dst[col] += lower[col] * scale; // Lower value
+						}
+					}
+					for (size_t col = tile; col < tile_end; col++)
+						dst[col] /= normalization;
+				}
+			}
+		});
+}
+
+// Build the kernel of a filter_size-point moving average with lower scaling for high offsets
+static Separable_kernel mean_kernel(const unsigned int filter_size)
+{
+	Separable_kernel kernel{ std::vector<float>(filter_size / 2 + 1), 1 };
+	kernel.weights[0] = 1;
+	for (size_t offset = 1; offset < kernel.weights.size(); offset++)
+	{
+		kernel.weights[offset] = 1 / static_cast<float>(pow(2, offset)); // Lower scaling for high offsets
+		kernel.normalization += 2 * kernel.weights[offset];
+	}
+	return kernel;
+}
+
+/* Return the kernel equivalent to filtering with a and then with b. Convolution on the wrapped heightmap is
+	associative, so the result only differs from running both kernels by floating point rounding. */
+static Separable_kernel fuse_kernels(const Separable_kernel& a, const Separable_kernel& b)
+{
+	const ptrdiff_t radius_a{ static_cast<ptrdiff_t>(a.weights.size()) - 1 };
+	const ptrdiff_t radius_b{ static_cast<ptrdiff_t>(b.weights.size()) - 1 };
+	Separable_kernel fused{ std::vector<float>(a.weights.size() + b.weights.size() - 1), a.normalization * b.normalization };
+	for (ptrdiff_t offset = 0; offset <= radius_a + radius_b; offset++)
+		for (ptrdiff_t i = -radius_a; i <= radius_a; i++)
+			if (std::abs(offset - i) <= radius_b)
+				fused.weights[offset] += a.weights[std::abs(i)] * b.weights[std::abs(offset - i)];
+	return fused;
+}
+
+/* Write the average of the 2 * radius + 1 wrapped elements around each element of the row src to dst. The
+	window sum is updated by adding the element entering and subtracting the element leaving it, so the cost
+	per element does not depend on radius. Sums are kept in double precision to avoid accumulating drift. */
+static void box_row(const float* src, float* dst, const size_t width, const size_t radius, std::vector<float>& padded)
+{
+	padded.resize(width + 2 * radius);
+	pad_row(src, width, radius, padded);
+	const double scale{ 1.0 / (2 * radius + 1) };
+	double sum{};
+	for (size_t i = 0; i < 2 * radius; i++)
+		sum += padded[i];
+	for (size_t col = 0; col < width; col++)
+	{
+		sum += padded[col + 2 * radius]; // Element entering the window
+		dst[col] = static_cast<float>(sum * scale);
+		sum -= padded[col]; // Element leaving the window
+	}
+}
+
+/* Write the average of the 2 * radius + 1 wrapped rows around each row of src to dst. Each worker keeps one
+	running sum per column for its band of rows and slides it down one row at a time by adding and subtracting
+	whole rows, which vectorizes across the columns. */
+static void box_columns(const Heightmap& src, Heightmap& dst, const size_t width, const size_t radius)
+{
+	const double scale{ 1.0 / (2 * radius + 1) };
+	const auto wrapped_row = [&](const ptrdiff_t row)
+	{
+		const ptrdiff_t w{ static_cast<ptrdiff_t>(width) };
+		return src.data() + static_cast<size_t>((row % w + w) % w) * width;
+	};
+
+	parallel_for(0, width, [&](const size_t first_row, const size_t last_row)
+		{
+			std::vector<double> sums(width);
+			for (ptrdiff_t offset = -static_cast<ptrdiff_t>(radius); offset <= static_cast<ptrdiff_t>(radius); offset++)
+			{
+				const float* row{ wrapped_row(static_cast<ptrdiff_t>(first_row) + offset) };
+				for (size_t col = 0; col < width; col++)
+					sums[col] += row[col];
+			}
+
+			for (size_t row = first_row; row < last_row; row++)
+			{
+				float* out{ dst.data() + row * width };
+				const float* entering{ wrapped_row(static_cast<ptrdiff_t>(row + radius + 1)) };
+				const float* leaving{ wrapped_row(static_cast<ptrdiff_t>(row) - static_cast<ptrdiff_t>(radius)) };
+				for (size_t col = 0; col < width; col++)
+				{
+					out[col] = static_cast<float>(sums[col] * scale);
+					sums[col] += entering[col] - static_cast<double>(leaving[col]);
+				}
+			}
+		});
+}
+
+/* Apply one box filter per radius in radii to arr, wrapping around the edges. Box filters are separable and
+	commute, so all horizontal passes are run on each row while it is in cache, followed by one vertical
+	sweep per radius. */
+static void box_filters(Heightmap& arr, const std::vector<size_t>& radii)
+{
+	const size_t arr_width = static_cast<size_t>(sqrt(arr.size())); // width = height of terrain array
+	Heightmap arr_tmp(arr.size());
+
+	// Horizontal filters
+	parallel_for(0, arr_width, [&](const size_t first_row, const size_t last_row)
+		{
+			std::vector<float> padded;
+			std::vector<float> row_tmp(arr_width);
+			for (size_t row = first_row; row < last_row; row++)
+			{
+				float* data{ arr.data() + row * arr_width };
+				for (const size_t radius : radii)
+				{
+					box_row(data, row_tmp.data(), arr_width, radius, padded);
+					std::copy(row_tmp.begin(), row_tmp.end(), data);
+				}
+			}
+		});
+
+	// Vertical filters
+	for (const size_t radius : radii)
+	{
+		box_columns(arr, arr_tmp, arr_width, radius);
+		arr.swap(arr_tmp);
+	}
+}
+
+/* Return the radii of three box filters approximating a Gaussian with standard deviation sigma.
+	From P. Kovesi, "Fast almost-Gaussian filtering". */
+static std::vector<size_t> gauss_box_radii(const double sigma)
+{
+	constexpr int passes{ 3 };
+	int lower_width{ static_cast<int>(std::floor(std::sqrt(12 * sigma * sigma / passes + 1))) };
+	if (lower_width % 2 == 0)
+		lower_width--;
+	const int lower_count{ static_cast<int>(std::round((12 * sigma * sigma - passes * lower_width * lower_width - 4 * passes * lower_width - 3 * passes) / (-4 * lower_width - 4))) };
+
+	std::vector<size_t> radii;
+	for (int i = 0; i < passes; i++)
+		radii.push_back(static_cast<size_t>((i < lower_count ? lower_width : lower_width + 2) / 2));
+	return radii;
+}
+
+using Sorting_network = std::vector<std::pair<size_t, size_t>>;
+
+// Compare-exchange pairs that leave the median of 5 or 9 values in the middle element.
+// From N. Devillard, "Fast median search: an ANSI C implementation".
+static const Sorting_network median5_network{
+	{ 0, 1 }, { 3, 4 }, { 0, 3 }, { 1, 4 }, { 1, 2 }, { 2, 3 }, { 1, 2 }
+};
+static const Sorting_network median9_network{
+	{ 1, 2 }, { 4, 5 }, { 7, 8 }, { 0, 1 }, { 3, 4 }, { 6, 7 }, { 1, 2 }, { 4, 5 }, { 7, 8 }, { 0, 3 },
+	{ 5, 8 }, { 4, 7 }, { 3, 6 }, { 1, 4 }, { 2, 5 }, { 4, 7 }, { 4, 2 }, { 6, 4 }, { 4, 2 }
+};
+
+// Build Batcher's odd-even merge sort network for n elements, O(n log^2 n) compare-exchanges
+static Sorting_network odd_even_merge_network(const size_t n)
+{
+	Sorting_network network;
+	for (size_t p = 1; p < n; p *= 2)
+		for (size_t k = p; k >= 1; k /= 2)
+			for (size_t j = k % p; j + k < n; j += 2 * k)
+				for (size_t i = 0; i < std::min(k, n - j - k); i++)
+					if ((i + j) / (2 * p) == (i + j + k) / (2 * p))
+						network.emplace_back(i + j, i + j + k);
+	return network;
+}
+
+/* Write the median of the source rows to dst for each of the width columns using a compare-exchange network.
+	The sources are copied into the scratch rows values, then each compare-exchange is a min/max over whole
+	rows which vectorizes across the columns. */
+static void median_row_network(const std::vector<const float*>& sources, float* dst, const size_t width,
+	const Sorting_network& network, std::vector<float>& values)
+{
+	const size_t n{ sources.size() };
+	values.resize(n * width);
+	for (size_t j = 0; j < n; j++)
+		std::copy(sources[j], sources[j] + width, values.begin() + j * width);
+
+	for (const auto& [a, b] : network)
+	{
+		float* row_a{ values.data() + a * width };
+		float* row_b{ values.data() + b * width };
+		for (size_t col = 0; col < width; col++)
+		{
+			const float low{ std::min(row_a[col], row_b[col]) };
+			const float high{ std::max(row_a[col], row_b[col]) };
+			row_a[col] = low;
+			row_b[col] = high;
+		}
+	}
+
+	std::copy(values.begin() + (n / 2) * width, values.begin() + (n / 2 + 1) * width, dst);
+}
+
+/* Do median filtering on arr with filter_size number of elements in each direction. The kernel is a cross of
+	filter_size / 2 elements left, right, above and below the current element. Each output row is computed
+	from a set of source rows: the current row padded with its wrapped neighbours (offset left and right)
+	and the wrapped rows above and below. 3- and 5-point filters use minimal median networks, larger
+	filters sort with an odd-even merge network. Rows are split over worker threads. */
+void median_filter(Heightmap& arr, const unsigned int filter_size)
+{
+	const size_t arr_width = static_cast<size_t>(sqrt(arr.size())); // width = height of terrain array
+	const size_t radius{ filter_size / 2 };
+	if (radius == 0)
+		return;
+	const size_t kernel_size{ 4 * radius + 1 };
+	const Sorting_network network{ kernel_size == 5 ? median5_network
+			: kernel_size == 9                     ? median9_network
+												   : odd_even_merge_network(kernel_size) };
+	Heightmap arr_tmp(arr.size());
+
+	parallel_for(0, arr_width, [&](const size_t first_row, const size_t last_row)
+		{
+			std::vector<float> padded(arr_width + 2 * radius);
+			std::vector<const float*> sources(kernel_size);
+			std::vector<float> scratch; // Rows sorted by the median network
+			for (size_t row = first_row; row < last_row; row++)
+			{
+				const float* src{ arr.data() + row * arr_width };
+				pad_row(src, arr_width, radius, padded);
+				const float* center{ padded.data() + radius };
+
+				sources[0] = center;
+				for (size_t offset = 1; offset <= radius; offset++)
+				{
+					size_t j = 4 * (offset - 1); // Index for sources vector
+					sources[j + 1] = center - offset; // Left values
+					sources[j + 2] = center + offset; // Right values
+					sources[j + 3] = arr.data() + ((row + arr_width - offset % arr_width) % arr_width) * arr_width; // Upper values
+					sources[j + 4] = arr.data() + ((row + offset) % arr_width) * arr_width; // Lower values
+				}
+
+				median_row_network(sources, arr_tmp.data() + row * arr_width, arr_width, network, scratch);
+			}
+		});
+	arr.swap(arr_tmp);
+}
+
+// Return the name used for a filter type in settings.ini
+static const char* filter_name(const Filter_stage::Type type)
+{
+	switch (type)
+	{
+	case Filter_stage::Type::mean: return "mean";
+	case Filter_stage::Type::median: return "median";
+	case Filter_stage::Type::box: return "box";
+	case Filter_stage::Type::gauss: return "gauss";
+	}
+	return "unknown";
+}
+
+// Parse a comma separated filter list such as "median:3, mean:5, box:32"
+std::vector<Filter_stage> parse_filter_pipeline(const std::string& description)
+{
+	std::vector<Filter_stage> stages;
+	std::istringstream iss(description);
+	std::string entry;
+	while (std::getline(iss, entry, ','))
+	{
+		// Remove surrounding spaces, skip empty entries
+		const size_t entry_start{ entry.find_first_not_of(' ') };
+		if (entry_start == std::string::npos)
+			continue;
+		entry = entry.substr(entry_start, entry.find_last_not_of(' ') + 1 - entry_start);
+
+		const size_t delimiter{ entry.find(':') };
+		const std::string name{ entry.substr(0, delimiter) };
+		Filter_stage stage{};
+		if (name == "mean")
+			stage.type = Filter_stage::Type::mean;
+		else if (name == "median")
+			stage.type = Filter_stage::Type::median;
+		else if (name == "box")
+			stage.type = Filter_stage::Type::box;
+		else if (name == "gauss")
+			stage.type = Filter_stage::Type::gauss;
+		else
+		{
+			std::cerr << "parse_filter_pipeline: ignoring unknown filter '" << entry << "'\n";
+			continue;
+		}
+
+		std::istringstream size_stream(delimiter == std::string::npos ? std::string() : entry.substr(delimiter + 1));
+		if (!(size_stream >> stage.size) || !(size_stream >> std::ws).eof() || stage.size == 0)
+		{
+			std::cerr << "parse_filter_pipeline: ignoring filter '" << entry << "', expected type:size\n";
+			continue;
+		}
+		stages.push_back(stage);
+	}
+	return stages;
+}
+
+/* Run the filter stages on arr in order. All filters except median are linear and separable, so a run of
+	them can be reordered freely: the mean stages in a run are fused into a single kernel, and the box and
+	Gaussian stages into one set of running sum passes. The time spent in each pass is printed. */
+void run_filter_pipeline(Heightmap& arr, const std::vector<Filter_stage>& stages)
+{
+	const auto stage_name = [](const Filter_stage& stage)
+	{
+		return filter_name(stage.type) + std::string(":") + std::to_string(stage.size);
+	};
+	const auto print_time = [](const std::string& pass_name, const std::chrono::steady_clock::time_point start_time)
+	{
+		const std::chrono::duration<double, std::milli> elapsed{ std::chrono::steady_clock::now() - start_time };
+		std::cout << "Terrain filter " << pass_name << ": " << elapsed.count() << " ms\n";
+	};
+
+	for (size_t i = 0; i < stages.size();)
+	{
+		if (stages[i].type == Filter_stage::Type::median)
+		{
+			const auto start_time{ std::chrono::steady_clock::now() };
+			median_filter(arr, stages[i].size);
+			print_time(stage_name(stages[i]), start_time);
+			i++;
+			continue;
+		}
+
+		// Collect all following linear stages
+		Separable_kernel kernel{ { 1.0f }, 1.0f };
+		std::vector<size_t> box_radii;
+		std::string kernel_name, box_name;
+		for (; i < stages.size() && stages[i].type != Filter_stage::Type::median; i++)
+		{
+			std::string& pass_name{ stages[i].type == Filter_stage::Type::mean ? kernel_name : box_name };
+			pass_name += (pass_name.empty() ? "" : " + ") + stage_name(stages[i]);
+			if (stages[i].type == Filter_stage::Type::mean)
+				kernel = fuse_kernels(kernel, mean_kernel(stages[i].size));
+			else if (stages[i].type == Filter_stage::Type::box)
+				box_radii.push_back(stages[i].size / 2);
+			else
+			{
+				const std::vector<size_t> gauss_radii{ gauss_box_radii(stages[i].size / 6.0) };
+				box_radii.insert(box_radii.end(), gauss_radii.begin(), gauss_radii.end());
+			}
+		}
+
+		if (!kernel_name.empty())
+		{
+			const auto start_time{ std::chrono::steady_clock::now() };
+			convolve_separable(arr, kernel.weights, kernel.normalization);
+			print_time(kernel_name, start_time);
+		}
+		if (!box_name.empty())
+		{
+			const auto start_time{ std::chrono::steady_clock::now() };
+			box_filters(arr, box_radii);
+			print_time(box_name, start_time);
+		}
+	}
+}
@@ -0,0 +1,29 @@
+/* Filters for generated heightmaps and the configurable filter pipeline built from them */
+#pragma once
+#include "heightmap.h"
+#include <string>
+#include <vector>
+
+// One stage of the terrain filter pipeline, described in settings.ini as type:size
+struct Filter_stage
+{
+	enum class Type
+	{
+		mean, // Moving average with lower weights for high offsets
+		median, // Median over a cross of elements
+		box, // Moving average with equal weights
+		gauss // Approximate Gaussian, size is the kernel width of about 6 standard deviations
+	};
+
+	Type type;
+	unsigned int size; // Number of elements along one direction
+};
+
+// Do median filtering on arr with filter_size number of elements in each direction
+void median_filter(Heightmap& arr, const unsigned int filter_size);
+
+// Parse a comma separated filter list such as "median:3, mean:5, gauss:128", invalid entries are skipped
+std::vector<Filter_stage> parse_filter_pipeline(const std::string& description);
+
+// Run the filter stages on arr in order, fusing adjacent separable stages and printing the time spent in each pass
+void run_filter_pipeline(Heightmap& arr, const std::vector<Filter_stage>& stages);
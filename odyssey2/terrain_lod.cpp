@@ -0,0 +1,98 @@
+/* Continuous distance-dependent level of detail (CDLOD) for terrain drawn from the heightmap texture */
+#include "terrain_lod.h"
+#include "frustum.h"
+#include "height_pyramid.h"
+#include "heightfield.h"
+#include <glm/vec3.hpp>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <vector>
+
+// Largest node size, log2 of the number of cells along each side
+static constexpr int max_node_level{ 5 };
+
+// Fraction of a level's range, counted from the end of the previous level, after which its vertices start to morph
+static constexpr float morph_start_ratio{ 0.7f };
+
+/* Set up the levels for heightfield. Ranges keep a grid cell below pixel_error pixels on a viewport
+	viewport_height pixels high with vertical field of view fov_y (radians), the coarsest level reaches far. */
+Terrain_lod::Terrain_lod(const Heightfield& heightfield, const Height_pyramid& pyramid, const float pixel_error,
+	const float viewport_height, const float fov_y, const float far)
+{
+	node_pyramid_level = std::min(max_node_level, pyramid.top());
+	node_cells = 1u << node_pyramid_level;
+	const int levels{ pyramid.top() - node_pyramid_level + 1 };
+
+	// A length L at distance d covers about L * pixels_per_radian / d pixels
+	const float pixels_per_radian{ viewport_height / (2.0f * std::tan(fov_y / 2.0f)) };
+	float previous_range{ 0.0f };
+	for (int level = 0; level < levels; level++)
+	{
+		const float cell_size{ heightfield.xz_scale() * static_cast<float>(1u << level) };
+		/* A level ends where the cells of the next coarser level, twice as large, shrink to pixel_error pixels.
+			Levels must be at least two nodes deep, otherwise a node could border one two levels coarser. */
+		const float next_cell_size{ 2.0f * cell_size };
+		float range{ std::max(next_cell_size * pixels_per_radian / std::max(pixel_error, 0.01f), 2.0f * cell_size * node_cells) };
+		range = std::max(range, 2.0f * previous_range);
+		if (level == levels - 1)
+			range = std::max(range, far);
+		ranges.push_back(range);
+		morph_starts.push_back(previous_range + (range - previous_range) * morph_start_ratio);
+		previous_range = range;
+	}
+}
+
+// True if the box from min to max is within radius of center
+static bool intersects_sphere(const glm::vec3& min, const glm::vec3& max, const glm::vec3& center, const float radius)
+{
+	const glm::vec3 offset{ glm::max(min - center, glm::vec3(0.0f)) + glm::max(center - max, glm::vec3(0.0f)) };
+	return offset.x * offset.x + offset.y * offset.y + offset.z * offset.z <= radius * radius;
+}
+
+// Replace the contents of nodes with the nodes to draw for a camera at position with the given frustum
+void Terrain_lod::select(const Heightfield& heightfield, const Height_pyramid& pyramid, const glm::vec3& position,
+	const Frustum& frustum, std::vector<Lod_node>& nodes) const
+{
+	nodes.clear();
+	if (!ranges.empty())
+		select_node(heightfield, pyramid, position, frustum, static_cast<uint32_t>(ranges.size() - 1), 0, 0, nodes);
+}
+
+/* Select node (x, z) of level or parts of it. Returns false if the node is out of range of its level,
+	its parent then draws that quarter itself. */
+bool Terrain_lod::select_node(const Heightfield& heightfield, const Height_pyramid& pyramid, const glm::vec3& position,
+	const Frustum& frustum, const uint32_t level, const uint32_t x, const uint32_t z, std::vector<Lod_node>& nodes) const
+{
+	float min_height{};
+	float max_height{};
+	pyramid.height_range(heightfield, node_pyramid_level + static_cast<int>(level), x, z, min_height, max_height);
+	if (min_height > max_height)
+		return true; // Outside the grid, nothing to draw
+
+	const uint32_t grid_size{ node_cells << level }; // Grid points covered along each side
+	const float size{ static_cast<float>(grid_size) * heightfield.xz_scale() };
+	const glm::vec3 min{ x * size, min_height, z * size };
+	const glm::vec3 max{ min.x + size, max_height, min.z + size };
+	if (!intersects_sphere(min, max, position, ranges[level]))
+		return false;
+	if (!intersects(frustum, min, max))
+		return true;
+
+	// Draw the whole node if none of it is close enough for the next finer level
+	if (level == 0 || !intersects_sphere(min, max, position, ranges[level - 1]))
+	{
+		nodes.push_back(Lod_node{ x * grid_size, z * grid_size, level, node_cells });
+		return true;
+	}
+
+	// Otherwise the children draw themselves and the quarters of those out of their range are drawn at this level
+	for (uint32_t q = 0; q < 4; q++)
+	{
+		const uint32_t qx{ q & 1 };
+		const uint32_t qz{ q >> 1 };
+		if (!select_node(heightfield, pyramid, position, frustum, level - 1, x * 2 + qx, z * 2 + qz, nodes))
+			nodes.push_back(Lod_node{ x * grid_size + qx * grid_size / 2, z * grid_size + qz * grid_size / 2, level, node_cells / 2 });
+	}
+	return true;
+}
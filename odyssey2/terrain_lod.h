@@ -0,0 +1,56 @@
+/* Continuous distance-dependent level of detail (CDLOD) for terrain drawn from the heightmap texture */
+#pragma once
+#include "frustum.h"
+#include "height_pyramid.h"
+#include "heightfield.h"
+#include <glm/vec3.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Square of grid cells drawn at one level of detail, as the rows of a regular grid pulled from the heightmap texture
+struct Lod_node
+{
+	uint32_t x; // Grid column of the first vertex
+	uint32_t z; // Grid row of the first vertex
+	uint32_t level; // Level of detail, the node's grid step is 2^level grid points
+	uint32_t cells; // Cells along each side, in steps of the node's level
+};
+
+/* CDLOD (Strugar 2009) over a Heightfield. Level l uses every 2^l-th grid point and is drawn up to ranges[l]
+	from the camera. Nodes are squares of node_cells * node_cells cells of their level and get their bounds from
+	the min/max height pyramid. Vertices morph to the grid of the next coarser level over the last part of their
+	range, so nodes of neighbouring levels meet without cracks. */
+class Terrain_lod
+{
+public:
+	Terrain_lod() = default;
+
+	/* Set up the levels for heightfield. Ranges keep a grid cell below pixel_error pixels on a viewport
+		viewport_height pixels high with vertical field of view fov_y (radians), the coarsest level reaches far. */
+	Terrain_lod(const Heightfield& heightfield, const Height_pyramid& pyramid, const float pixel_error,
+		const float viewport_height, const float fov_y, const float far);
+
+	// Replace the contents of nodes with the nodes to draw for a camera at position with the given frustum
+	void select(const Heightfield& heightfield, const Height_pyramid& pyramid, const glm::vec3& position,
+		const Frustum& frustum, std::vector<Lod_node>& nodes) const;
+
+	// Distance from the camera where vertices of level start morphing to the next coarser level
+	float morph_start(const uint32_t level) const { return morph_starts[level]; }
+
+	// Distance from the camera where vertices of level have become vertices of the next coarser level
+	float morph_end(const uint32_t level) const { return ranges[level]; }
+
+	size_t level_count() const { return ranges.size(); }
+
+private:
+	/* Select node (x, z) of level or parts of it. Returns false if the node is out of range of its level,
+		its parent then draws that quarter itself. */
+	bool select_node(const Heightfield& heightfield, const Height_pyramid& pyramid, const glm::vec3& position,
+		const Frustum& frustum, const uint32_t level, const uint32_t x, const uint32_t z, std::vector<Lod_node>& nodes) const;
+
+	std::vector<float> ranges{}; // Furthest distance from the camera each level is drawn at
+	std::vector<float> morph_starts{};
+	uint32_t node_cells{ 1 }; // Cells along each side of a node
+	int node_pyramid_level{ 0 }; // Pyramid level with the bounds of level 0 nodes, log2(node_cells)
+};
@@ -0,0 +1,387 @@
+/* CPU-side terrain mesh building and upload of finished meshes to the GPU */
+#include "terrain_mesh.h"
+#include "heightfield.h"
+#include "model.h"
+#include "parallel.h"
+#include <glad/glad.h>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <iostream>
+#include <string>
+#include <vector>
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+
+// Parse "f32" or "quantized", returns f32 for anything else
+Terrain_vertex_format parse_terrain_vertex_format(const std::string& name)
+{
+	if (name == "quantized")
+		return Terrain_vertex_format::quantized;
+	if (name != "f32")
+		std::cerr << "parse_terrain_vertex_format: unknown vertex format '" << name << "', using f32\n";
+	return Terrain_vertex_format::f32;
+}
+
+// Size in bytes of one vertex in format
+size_t terrain_vertex_size(const Terrain_vertex_format format)
+{
+	return format == Terrain_vertex_format::f32 ? sizeof(Terrain_vertex) : sizeof(Terrain_vertex_quantized);
+}
+
+// Pack a unit vector into the signed normalized GL_INT_2_10_10_10_REV format with w = 0
+GLuint pack_normal_2_10_10_10(const float x, const float y, const float z)
+{
+	const auto pack = [](const float v)
+	{
+		return static_cast<GLuint>(static_cast<int>(std::lround(std::clamp(v, -1.0f, 1.0f) * 511.0f))) & 0x3FFu;
+	};
+	return pack(x) | (pack(y) << 10) | (pack(z) << 20);
+}
+
+/* Compute unit normals of heightfield from central differences, wrapping around the edges like the
+	heightmap does. Each worker handles a band of rows: the rows above and below are decoded next to
+	the current one, which is padded with its wrapped neighbours, so the inner loops run without any
+	index wrapping. The normals are computed eight at a time with AVX where available. Writes three floats per vertex to normals and one packed normal per
+	vertex to packed, either may be null. */
+void compute_terrain_normals(const Heightfield& heightfield, GLfloat* normals, GLuint* packed)
+{
+	const size_t width{ heightfield.width() };
+	const float step{ 2.0f * heightfield.xz_scale() }; // Distance between the two samples of a difference
+	parallel_for(0, width, [&](const size_t first_row, const size_t last_row)
+		{
+			std::vector<float> above(width);
+			std::vector<float> center(width + 2);
+			std::vector<float> below(width);
+			std::vector<float> nx(width);
+			std::vector<float> ny(width);
+			std::vector<float> nz(width);
+			for (size_t z = first_row; z < last_row; z++)
+			{
+				heightfield.decode(((z + width - 1) % width) * width, width, above.data());
+				heightfield.decode(z * width, width, center.data() + 1);
+				heightfield.decode(((z + 1) % width) * width, width, below.data());
+				center[0] = center[width];
+				center[width + 1] = center[1];
+
+				// Normal of the plane through the differences in x and z, (-dx, step, -dz) normalized
+				size_t x{ 0 };
+#ifdef __AVX__
+				const __m256 step_8{ _mm256_set1_ps(step) };
+				const __m256 step_squared{ _mm256_set1_ps(step * step) };
+				const __m256 one{ _mm256_set1_ps(1.0f) };
+				const __m256 zero{ _mm256_setzero_ps() };
+				for (; x + 8 <= width; x += 8)
+				{
+					const __m256 dx{ _mm256_sub_ps(_mm256_loadu_ps(center.data() + x + 2), _mm256_loadu_ps(center.data() + x)) };
+					const __m256 dz{ _mm256_sub_ps(_mm256_loadu_ps(below.data() + x), _mm256_loadu_ps(above.data() + x)) };
+					const __m256 length_squared{ _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dz, dz)), step_squared) };
+					const __m256 inv_length{ _mm256_div_ps(one, _mm256_sqrt_ps(length_squared)) };
+					_mm256_storeu_ps(nx.data() + x, _mm256_mul_ps(_mm256_sub_ps(zero, dx), inv_length));
+					_mm256_storeu_ps(ny.data() + x, _mm256_mul_ps(step_8, inv_length));
+					_mm256_storeu_ps(nz.data() + x, _mm256_mul_ps(_mm256_sub_ps(zero, dz), inv_length));
+				}
+#endif
+				for (; x < width; x++)
+				{
+					const float dx{ center[x + 2] - center[x] };
+					const float dz{ below[x] - above[x] };
+					const float inv_length{ 1.0f / std::sqrt(dx * dx + dz * dz + step * step) };
+					nx[x] = -dx * inv_length;
+					ny[x] = step * inv_length;
+					nz[x] = -dz * inv_length;
+				}
+
+				if (normals)
+				{
+					GLfloat* const out{ normals + z * width * 3 };
+					for (size_t x = 0; x < width; x++)
+					{
+						out[x * 3] = nx[x];
+						out[x * 3 + 1] = ny[x];
+						out[x * 3 + 2] = nz[x];
+					}
+				}
+				if (packed)
+				{
+					GLuint* const out{ packed + z * width };
+					for (size_t x = 0; x < width; x++)
+						out[x] = pack_normal_2_10_10_10(nx[x], ny[x], nz[x]);
+				}
+			}
+		}, 16);
+}
+
+// Split a world_size*world_size grid into chunks of at most terrain_chunk_cells*terrain_chunk_cells cells
+Terrain_chunk_layout terrain_chunk_layout(const unsigned int world_size)
+{
+	// Each distinct chunk size (full, cut off at the right, bottom or both) has its own indices
+	struct Pattern
+	{
+		unsigned int cells_x;
+		unsigned int cells_z;
+		size_t first_index;
+	};
+	std::vector<Pattern> patterns;
+
+	Terrain_chunk_layout layout{ {}, 0, 0 };
+	const unsigned int cells{ world_size > 0 ? world_size - 1 : 0 };
+	for (unsigned int z = 0; z < cells; z += terrain_chunk_cells)
+	{
+		for (unsigned int x = 0; x < cells; x += terrain_chunk_cells)
+		{
+			Terrain_chunk chunk{ x, z, std::min(terrain_chunk_cells, cells - x), std::min(terrain_chunk_cells, cells - z), 0, 0, 0 };
+			chunk.first_vertex = static_cast<GLint>(layout.vertex_count);
+			chunk.index_count = static_cast<GLsizei>(chunk.cells_x * chunk.cells_z * 6);
+			const auto pattern = std::find_if(patterns.begin(), patterns.end(), [&](const Pattern& p)
+				{
+					return p.cells_x == chunk.cells_x && p.cells_z == chunk.cells_z;
+				});
+			if (pattern == patterns.end())
+			{
+				chunk.first_index = layout.index_count;
+				patterns.push_back(Pattern{ chunk.cells_x, chunk.cells_z, chunk.first_index });
+				layout.index_count += static_cast<size_t>(chunk.index_count);
+			}
+			else
+			{
+				chunk.first_index = pattern->first_index;
+			}
+			layout.vertex_count += static_cast<size_t>(chunk.cells_x + 1) * (chunk.cells_z + 1);
+			layout.chunks.push_back(chunk);
+		}
+	}
+	return layout;
+}
+
+/* Split a world_size*world_size grid into patches of at most terrain_patch_cells*terrain_patch_cells cells, in the same
+	row-major order as terrain_chunk_layout. A patch is drawn from its four corner vertices starting at first_vertex,
+	there are no indices. */
+std::vector<Terrain_chunk> terrain_patch_layout(const unsigned int world_size)
+{
+	std::vector<Terrain_chunk> patches;
+	const unsigned int cells{ world_size > 0 ? world_size - 1 : 0 };
+	for (unsigned int z = 0; z < cells; z += terrain_patch_cells)
+	{
+		for (unsigned int x = 0; x < cells; x += terrain_patch_cells)
+		{
+			patches.push_back(Terrain_chunk{ x, z, std::min(terrain_patch_cells, cells - x), std::min(terrain_patch_cells, cells - z),
+				static_cast<GLint>(patches.size() * 4), 0, 0 });
+		}
+	}
+	return patches;
+}
+
+/* Write the indices of a chunk of cells_x*cells_z cells with row-major vertices. The cells are visited in
+	vertical strips of strip_cells columns, row by row within a strip, so a row only reuses vertices of the
+	row before it. Two rows of a strip fit in a post-transform cache of 2 * (strip_cells + 1) vertices,
+	which makes almost every vertex a cache miss only once instead of twice for full-width rows. */
+static void write_chunk_indices(const unsigned int cells_x, const unsigned int cells_z, const unsigned int strip_cells, GLushort* out)
+{
+	const unsigned int row{ cells_x + 1 };
+	for (unsigned int strip = 0; strip < cells_x; strip += strip_cells)
+	{
+		const unsigned int strip_end{ std::min(strip + strip_cells, cells_x) };
+		for (unsigned int z = 0; z < cells_z; z++)
+		{
+			for (unsigned int x = strip; x < strip_end; x++)
+			{
+				const GLushort vertex{ static_cast<GLushort>(x + z * row) };
+				// Triangle 1
+				*out++ = vertex;
+				*out++ = static_cast<GLushort>(vertex + row);
+				*out++ = static_cast<GLushort>(vertex + 1);
+				// Triangle 2
+				*out++ = static_cast<GLushort>(vertex + 1);
+				*out++ = static_cast<GLushort>(vertex + row);
+				*out++ = static_cast<GLushort>(vertex + row + 1);
+			}
+		}
+	}
+}
+
+// Strip width for write_chunk_indices, two rows of 15 vertices fit in a 32 entry cache
+static constexpr unsigned int strip_cells{ 14 };
+
+/* Fraction of vertices transformed per triangle (average cache miss ratio) when count indices are drawn
+	through a FIFO post-transform cache of cache_size vertices. Lower is better, about 0.5 is the best for grids. */
+double vertex_cache_acmr(const GLushort* indices, const size_t count, const size_t cache_size)
+{
+	if (count < 3 || cache_size == 0)
+		return 0.0;
+	std::vector<int> cache(cache_size, -1);
+	size_t next{ 0 };
+	size_t misses{ 0 };
+	for (size_t i = 0; i < count; i++)
+	{
+		if (std::find(cache.begin(), cache.end(), indices[i]) == cache.end())
+		{
+			cache[next] = indices[i];
+			next = (next + 1) % cache_size;
+			misses++;
+		}
+	}
+	return static_cast<double>(misses) / static_cast<double>(count / 3);
+}
+
+// vertex_format if a world_size*world_size mesh can use it, quantized grid positions have 16 bits so larger worlds use f32
+Terrain_vertex_format usable_vertex_format(const Terrain_vertex_format vertex_format, const unsigned int world_size)
+{
+	if (vertex_format == Terrain_vertex_format::quantized && world_size > 65536u)
+	{
+		std::cerr << "usable_vertex_format: world_size " << world_size << " is too large for quantized vertices, using f32\n";
+		return Terrain_vertex_format::f32;
+	}
+	return vertex_format;
+}
+
+/* Build the vertex and index arrays for heightfield, laid out in the chunks of terrain_chunk_layout. Quantized heights
+	are spread between min_height and max_height, which must hold all heights of the heightfield. vertex_format must be
+	usable for the heightfield's size, see usable_vertex_format. */
+Terrain_mesh build_terrain_mesh(const Heightfield& heightfield, const Terrain_vertex_format vertex_format,
+	const float min_height, const float max_height)
+{
+	const unsigned int world_size{ heightfield.width() };
+	const float world_xz_scale{ heightfield.xz_scale() };
+
+	const Terrain_chunk_layout layout{ terrain_chunk_layout(world_size) };
+	Terrain_mesh mesh{};
+	mesh.vertex_format = vertex_format;
+	if (vertex_format == Terrain_vertex_format::f32)
+		mesh.vertices.resize(layout.vertex_count);
+	else
+		mesh.quantized_vertices.resize(layout.vertex_count);
+	mesh.index_array.resize(layout.index_count);
+	std::vector<GLuint> normals(static_cast<size_t>(world_size) * world_size); // Row-major like the heightfield
+	compute_terrain_normals(heightfield, nullptr, normals.data());
+
+	// Indices of each distinct chunk size, written by the first chunk using them. The layout appends
+	// the indices of a new size when it first appears, so those chunks start at the end of the written indices.
+	size_t indices_written{ 0 };
+	for (const Terrain_chunk& chunk : layout.chunks)
+	{
+		if (chunk.first_index != indices_written)
+			continue;
+		write_chunk_indices(chunk.cells_x, chunk.cells_z, strip_cells, mesh.index_array.data() + chunk.first_index);
+		indices_written += static_cast<size_t>(chunk.index_count);
+	}
+
+	// Compare the post-transform cache use of the chunk order with plain row order
+	if (!layout.chunks.empty())
+	{
+		const Terrain_chunk& chunk{ layout.chunks.front() };
+		std::vector<GLushort> row_order(static_cast<size_t>(chunk.index_count));
+		write_chunk_indices(chunk.cells_x, chunk.cells_z, chunk.cells_x, row_order.data());
+		std::cout << "Terrain mesh " << layout.chunks.size() << " chunks, ACMR with a 32 vertex FIFO cache: "
+			<< vertex_cache_acmr(row_order.data(), row_order.size(), 32) << " in row order, "
+			<< vertex_cache_acmr(mesh.index_array.data() + chunk.first_index, row_order.size(), 32) << " in strips\n";
+	}
+
+	const float height_range{ max_height - min_height };
+	const float quantize_scale{ height_range > 0.0f ? 65535.0f / height_range : 0.0f };
+	parallel_for(0, layout.chunks.size(), [&](const size_t first_chunk, const size_t last_chunk)
+		{
+			std::vector<float> heights(terrain_chunk_cells + 1); // One decoded row of the chunk
+			for (size_t c = first_chunk; c < last_chunk; c++)
+			{
+				const Terrain_chunk& chunk{ layout.chunks[c] };
+				size_t vertex{ static_cast<size_t>(chunk.first_vertex) };
+				for (unsigned int z = chunk.z; z <= chunk.z + chunk.cells_z; z++)
+				{
+					const size_t row{ static_cast<size_t>(z) * world_size + chunk.x };
+					heightfield.decode(row, chunk.cells_x + 1, heights.data());
+					for (unsigned int i = 0; i <= chunk.cells_x; i++, vertex++)
+					{
+						const unsigned int x{ chunk.x + i };
+						if (vertex_format == Terrain_vertex_format::f32)
+						{
+							mesh.vertices[vertex] = Terrain_vertex{ { x * world_xz_scale, heights[i], z * world_xz_scale }, normals[row + i] };
+						}
+						else
+						{
+							const float quantized{ std::clamp((heights[i] - min_height) * quantize_scale, 0.0f, 65535.0f) };
+							mesh.quantized_vertices[vertex] = Terrain_vertex_quantized{
+								{ static_cast<GLushort>(x), static_cast<GLushort>(std::lround(quantized)), static_cast<GLushort>(z) }, 0,
+								normals[row + i] };
+						}
+					}
+				}
+			}
+		}, 1);
+
+	return mesh;
+}
+
+// View the arrays of mesh, valid as long as mesh is not modified
+Terrain_mesh_view view_terrain_mesh(const Terrain_mesh& mesh)
+{
+	if (mesh.vertex_format == Terrain_vertex_format::f32)
+		return Terrain_mesh_view{ mesh.vertex_format, mesh.vertices.data(), mesh.index_array.data(), mesh.vertices.size(), mesh.index_array.size() };
+	return Terrain_mesh_view{ mesh.vertex_format, mesh.quantized_vertices.data(), mesh.index_array.data(),
+		mesh.quantized_vertices.size(), mesh.index_array.size() };
+}
+
+/* Upload a finished mesh to the GPU and create a Model for it, requires a current OpenGL context.
+	The vertex attributes are set up once in the Model's VAO: position at location 0 and normal at location 1. */
+Model* upload_terrain_mesh(const Terrain_mesh_view& mesh)
+{
+	const GLsizei vertex_count{ static_cast<GLsizei>(mesh.vertex_count) };
+	const GLsizei index_count{ static_cast<GLsizei>(mesh.index_count) };
+	Model* m = new Model(vertex_count, index_count);
+
+	glGenVertexArrays(1, &m->vao);
+	glGenBuffers(1, &m->vb);
+	glGenBuffers(1, &m->ib);
+
+	const GLsizei stride{ static_cast<GLsizei>(terrain_vertex_size(mesh.vertex_format)) };
+	glBindVertexArray(m->vao);
+	glBindBuffer(GL_ARRAY_BUFFER, m->vb);
+	glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(mesh.vertex_count) * stride, mesh.vertices, GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m->ib);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, static_cast<GLsizeiptr>(mesh.index_count * sizeof(GLushort)), mesh.index_array, GL_STATIC_DRAW);
+
+	if (mesh.vertex_format == Terrain_vertex_format::f32)
+	{
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<const void*>(offsetof(Terrain_vertex, position)));
+		glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, reinterpret_cast<const void*>(offsetof(Terrain_vertex, normal)));
+	}
+	else
+	{
+		glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_FALSE, stride,
+			reinterpret_cast<const void*>(offsetof(Terrain_vertex_quantized, position)));
+		glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride,
+			reinterpret_cast<const void*>(offsetof(Terrain_vertex_quantized, normal)));
+	}
+	glEnableVertexAttribArray(0);
+	glEnableVertexAttribArray(1);
+
+	return m;
+}
+
+/* Upload the corner vertices of patches and create a Model for them, requires a current OpenGL context.
+	Corners are (x, z) grid positions at location 0, in the order (x, z), (x+1, z), (x+1, z+1), (x, z+1) of each patch. */
+Model* upload_terrain_patches(const std::vector<Terrain_chunk>& patches)
+{
+	std::vector<GLfloat> corners;
+	corners.reserve(patches.size() * 8);
+	for (const Terrain_chunk& patch : patches)
+	{
+		const GLfloat x0{ static_cast<GLfloat>(patch.x) };
+		const GLfloat z0{ static_cast<GLfloat>(patch.z) };
+		const GLfloat x1{ static_cast<GLfloat>(patch.x + patch.cells_x) };
+		const GLfloat z1{ static_cast<GLfloat>(patch.z + patch.cells_z) };
+		corners.insert(corners.end(), { x0, z0, x1, z0, x1, z1, x0, z1 });
+	}
+
+	Model* m = new Model(static_cast<GLsizei>(patches.size() * 4), 0);
+	glGenVertexArrays(1, &m->vao);
+	glGenBuffers(1, &m->vb);
+	glBindVertexArray(m->vao);
+	glBindBuffer(GL_ARRAY_BUFFER, m->vb);
+	glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(corners.size() * sizeof(GLfloat)), corners.data(), GL_STATIC_DRAW);
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat), nullptr);
+	glEnableVertexAttribArray(0);
+
+	return m;
+}
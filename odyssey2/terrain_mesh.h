@@ -0,0 +1,127 @@
+/* CPU-side terrain mesh building and upload of finished meshes to the GPU */
+#pragma once
+#include "heightfield.h"
+#include "model.h"
+#include <glad/glad.h>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Vertex layouts of the terrain mesh
+enum class Terrain_vertex_format
+{
+	f32, // Terrain_vertex, exact float position
+	quantized // Terrain_vertex_quantized, grid position and 16-bit height
+};
+
+// Parse "f32" or "quantized", returns f32 for anything else
+Terrain_vertex_format parse_terrain_vertex_format(const std::string& name);
+
+// Interleaved terrain vertex with a float position, 16 bytes
+struct Terrain_vertex
+{
+	GLfloat position[3]; // World position
+	GLuint normal; // GL_INT_2_10_10_10_REV
+};
+
+/* Interleaved terrain vertex with a quantized position, 12 bytes. The shader turns it into a world position
+	with position * (xz_scale, (max_height - min_height) / 65535, xz_scale) + (0, min_height, 0). */
+struct Terrain_vertex_quantized
+{
+	GLushort position[3]; // Grid column, height as unorm16 between min_height and max_height, grid row
+	GLushort padding; // Keeps normal 4-byte aligned
+	GLuint normal; // GL_INT_2_10_10_10_REV
+};
+
+// Size in bytes of one vertex in format
+size_t terrain_vertex_size(const Terrain_vertex_format format);
+
+// Grid cells along each side of a chunk, chunks at the far edges of the grid may be smaller
+constexpr unsigned int terrain_chunk_cells{ 128 };
+
+/* Rectangle of grid cells drawn with one glDrawElementsBaseVertex call. The vertices of a chunk are stored
+	contiguously, row-major within the chunk, so they can be addressed with 16-bit indices. Chunks with the
+	same number of cells share their indices. */
+struct Terrain_chunk
+{
+	unsigned int x; // Grid column of the chunk's first vertex
+	unsigned int z; // Grid row of the chunk's first vertex
+	unsigned int cells_x;
+	unsigned int cells_z;
+	GLint first_vertex; // Base vertex added to the chunk's indices
+	size_t first_index; // Offset of the chunk's indices in the index array
+	GLsizei index_count;
+};
+
+// Chunks covering a world_size*world_size grid and the sizes of the vertex and index arrays holding them
+struct Terrain_chunk_layout
+{
+	std::vector<Terrain_chunk> chunks;
+	size_t vertex_count;
+	size_t index_count;
+};
+
+// Split a world_size*world_size grid into chunks of at most terrain_chunk_cells*terrain_chunk_cells cells
+Terrain_chunk_layout terrain_chunk_layout(const unsigned int world_size);
+
+// Grid cells along each side of a tessellated patch. Tessellation levels go up to 64, so close patches get a vertex per grid point.
+constexpr unsigned int terrain_patch_cells{ 64 };
+
+/* Split a world_size*world_size grid into patches of at most terrain_patch_cells*terrain_patch_cells cells, in the same
+	row-major order as terrain_chunk_layout. A patch is drawn from its four corner vertices starting at first_vertex,
+	there are no indices. */
+std::vector<Terrain_chunk> terrain_patch_layout(const unsigned int world_size);
+
+/* Terrain mesh data built on the CPU, independent of any OpenGL context. Texture coordinates are
+	not stored since they follow from the world position. */
+struct Terrain_mesh
+{
+	Terrain_vertex_format vertex_format{ Terrain_vertex_format::f32 };
+
+	// Only one of these is used, depending on vertex_format. Vertices on chunk borders are stored once per chunk.
+	std::vector<Terrain_vertex> vertices;
+	std::vector<Terrain_vertex_quantized> quantized_vertices;
+
+	std::vector<GLushort> index_array; // Three chunk-relative indices per triangle
+};
+
+// Read-only view of terrain mesh arrays, owned by a Terrain_mesh or memory mapped from the terrain cache
+struct Terrain_mesh_view
+{
+	Terrain_vertex_format vertex_format;
+	const void* vertices; // vertex_count interleaved vertices in vertex_format
+	const GLushort* index_array; // Three chunk-relative indices per triangle
+	size_t vertex_count;
+	size_t index_count;
+};
+
+// View the arrays of mesh, valid as long as mesh is not modified
+Terrain_mesh_view view_terrain_mesh(const Terrain_mesh& mesh);
+
+// Pack a unit vector into the signed normalized GL_INT_2_10_10_10_REV format with w = 0
+GLuint pack_normal_2_10_10_10(const float x, const float y, const float z);
+
+/* Compute unit normals of heightfield from central differences, wrapping around the edges like the heightmap.
+	Writes three floats per vertex to normals and one packed normal per vertex to packed, either may be null. */
+void compute_terrain_normals(const Heightfield& heightfield, GLfloat* normals, GLuint* packed);
+
+/* Fraction of vertices transformed per triangle (average cache miss ratio) when count indices are drawn
+	through a FIFO post-transform cache of cache_size vertices. Lower is better, about 0.5 is the best for grids. */
+double vertex_cache_acmr(const GLushort* indices, const size_t count, const size_t cache_size);
+
+// vertex_format if a world_size*world_size mesh can use it, quantized grid positions have 16 bits so larger worlds use f32
+Terrain_vertex_format usable_vertex_format(const Terrain_vertex_format vertex_format, const unsigned int world_size);
+
+/* Build the vertex and index arrays for heightfield, laid out in the chunks of terrain_chunk_layout. Quantized heights are spread between min_height
+	and max_height, which must hold all heights of the heightfield. vertex_format must be usable for the heightfield's size,
+	see usable_vertex_format. */
+Terrain_mesh build_terrain_mesh(const Heightfield& heightfield, const Terrain_vertex_format vertex_format,
+	const float min_height, const float max_height);
+
+/* Upload a finished mesh to the GPU and create a Model for it, requires a current OpenGL context.
+	The vertex attributes are set up once in the Model's VAO: position at location 0 and normal at location 1. */
+Model* upload_terrain_mesh(const Terrain_mesh_view& mesh);
+
+/* Upload the corner vertices of patches and create a Model for them, requires a current OpenGL context.
+	Corners are (x, z) grid positions at location 0, in the order (x, z), (x+1, z), (x+1, z+1), (x, z+1) of each patch. */
+Model* upload_terrain_patches(const std::vector<Terrain_chunk>& patches);
@@ -1,5 +1,6 @@
 /* Miscellaneous utility functions for the main program */
 #include "util_misc.h"
+#include "parallel.h"
 #include <glad/glad.h>
 #include <iostream>
 #include <string>
@@ -7,26 +8,50 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
-// Load chosen cubemap textures. Based on code by Joey de Vries: https://learnopengl.com/Advanced-OpenGL/Cubemaps
-void load_cubemap(std::vector<GLuint>& skybox_tex)
+// Decode an image file without any OpenGL calls, can be run on a worker thread. data is null on failure.
+// stb_image only shares its failure reason between threads, which is not used here.
+Decoded_image decode_image(const std::string& filename)
+{
+	Decoded_image image;
+	image.data = std::unique_ptr<unsigned char, void (*)(void*)>(
+		stbi_load(filename.c_str(), &image.width, &image.height, &image.channels, 0), stbi_image_free);
+	return image;
+}
+
+// Decode the six faces of each skybox cubemap in parallel, can be run on a worker thread
+std::vector<std::vector<Decoded_image>> decode_cubemaps()
 {
 	const std::vector<std::string> skybox_paths = {
 		"stormydays", "hw_morning", "sb_frozen", "ame_starfield"
 	};
-	skybox_tex.resize(skybox_paths.size());
+	const std::vector<std::string> face_names{
+		"/front.tga", "/back.tga", "/top.tga", "/bottom.tga", "/right.tga", "/left.tga"
+	};
+	std::vector<std::vector<Decoded_image>> skybox_faces(skybox_paths.size());
+	for (auto& faces : skybox_faces)
+		faces.resize(face_names.size());
 
-	for (unsigned int skybox_index{}; skybox_index < skybox_paths.size(); skybox_index++)
-	{
-		const std::string skybox_path = "tex/skybox/" + skybox_paths.at(skybox_index % skybox_paths.size());
-		const std::vector<std::string> faces{
-			skybox_path + "/front.tga",
-			skybox_path + "/back.tga",
-			skybox_path + "/top.tga",
-			skybox_path + "/bottom.tga",
-			skybox_path + "/right.tga",
-			skybox_path + "/left.tga"
-		};
+	parallel_for(0, skybox_paths.size() * face_names.size(), [&](const size_t first, const size_t last)
+		{
+			for (size_t i = first; i < last; i++)
+			{
+				const size_t skybox_index{ i / face_names.size() };
+				const size_t face_index{ i % face_names.size() };
+				skybox_faces[skybox_index][face_index] = decode_image("tex/skybox/" + skybox_paths[skybox_index] + face_names[face_index]);
+				if (!skybox_faces[skybox_index][face_index].data)
+					std::cerr << "decode_cubemaps failed: texture " << skybox_paths[skybox_index] << face_names[face_index] << " failed to load\n";
+			}
+		});
+	return skybox_faces;
+}
+
+// Upload decoded cubemap faces into skybox textures. Based on code by Joey de Vries: https://learnopengl.com/Advanced-OpenGL/Cubemaps
+void load_cubemap(std::vector<GLuint>& skybox_tex, const std::vector<std::vector<Decoded_image>>& skybox_faces)
+{
+	skybox_tex.resize(skybox_faces.size());
 
+	for (unsigned int skybox_index{}; skybox_index < skybox_faces.size(); skybox_index++)
+	{
 		glGenTextures(1, &skybox_tex[skybox_index]);
 		glBindTexture(GL_TEXTURE_CUBE_MAP, skybox_tex[skybox_index]);
 		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
@@ -35,19 +60,13 @@ void load_cubemap(std::vector<GLuint>& skybox_tex)
 		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
 
-		int width, height, nr_channels;
+		const std::vector<Decoded_image>& faces{ skybox_faces[skybox_index] };
 		for (unsigned int i = 0; i < faces.size(); i++)
 		{
-			unsigned char* data = stbi_load(faces[i].c_str(), &width, &height, &nr_channels, 0);
-			if (!data)
-			{
-				std::cerr << "loadCubemap failed: texture " << faces[i] << " failed to load\n";
-				stbi_image_free(data);
-				exit(EXIT_FAILURE);
-			}
+			if (!faces[i].data)
+				exit_on_error("load_cubemap failed: missing cubemap face");
 			glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i,
-				0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-			stbi_image_free(data);
+				0, GL_RGB, faces[i].width, faces[i].height, 0, GL_RGB, GL_UNSIGNED_BYTE, faces[i].data.get());
 		}
 	}
 }
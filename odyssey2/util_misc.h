@@ -1,12 +1,28 @@
 /* Miscellaneous utility functions for the main program */
 #pragma once
 #include <cfloat>
+#include <cstdlib>
 #include <glad/glad.h>
+#include <memory>
+#include <string>
 #include <vector>
 
-// Load chosen cubemap textures
+// Image decoded by stb_image on the CPU, ready to be uploaded as a texture
+struct Decoded_image
+{
+	int width{}, height{}, channels{};
+	std::unique_ptr<unsigned char, void (*)(void*)> data{ nullptr, free };
+};
+
+// Decode an image file without any OpenGL calls, can be run on a worker thread. data is null on failure.
+Decoded_image decode_image(const std::string& filename);
+
+// Decode the six faces of each skybox cubemap in parallel, can be run on a worker thread
+std::vector<std::vector<Decoded_image>> decode_cubemaps();
+
+// Upload decoded cubemap faces (from decode_cubemaps) into skybox textures
 // TODO: Move load_cubemap to main.cpp (or to Shader?)
-void load_cubemap(std::vector<GLuint>& skybox_tex);
+void load_cubemap(std::vector<GLuint>& skybox_tex, const std::vector<std::vector<Decoded_image>>& skybox_faces);
 
 // Exit the program on unrecoverable error, printing an error string to stderr
 // TODO: Move exit_on_error to main.cpp